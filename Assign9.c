@@ -11,6 +11,7 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include <semphr.h>
+#include <timers.h>
 
 //C Headers
 #include <stdio.h>
@@ -21,190 +22,349 @@
 #include <math.h>
 
 
-//Pico Headers
-#include "pico/stdlib.h"
-#include "tusb.h"
-#include "pico/binary_info.h"
-#include "hardware/gpio.h"
-#include "hardware/i2c.h"
+//Pico Headers, for what only runs on the Pico: the second core and the
+//tickless idle timer. Everything else goes through the hardware layer.
+#ifndef HAL_HOST
 #include "hardware/spi.h"
 #include "hardware/adc.h"
 #include "hardware/uart.h"
-#include "hardware/timer.h"
-
-// I2C reserves some addresses for special purposes. We exclude these from the scan.
-// These are any addresses of the form 000 0xxx or 111 1xxx
-#define HDC1080TEMPREG 0x00
-#define HDC1080HUMREG 0x01
-#define HDC1080CONFIGREG 0x02
-#define HDC1080ADDRESS 0x40
-#define HDC1080SN1 0xFB
-#define HDC1080SN2 0xFC
-#define HDC1080SN3 0xFD
-#define HDC1080DEVICEIDREG 0xFE
-#define HDC1080DEVICEID 0xFF
-#define I2C_PORT i2c1
-
-//Step Motor Pins and steps
-//IN1=12,  IN2=9, IN3=8,IN4=19
-#define StepMotorIN1 12
-#define StepMotorIN2 1
-#define StepMotorIN3 0
-#define StepMotorIN4 6
-
-//Button pines
-#define ButtonS1 19
-#define ButtonS2 9
-#define ButtonS3 8
-
-//define 7-segment led pins
-#define SevenSegCC1 11  //right number
-#define SevenSegCC2 10  //left number
-
-#define SevenSegA 26    //Top bar
-#define SevenSegB 27    //Top right
-#define SevenSegC 29    //bottom right
-#define SevenSegD 18    //bottom bar
-#define SevenSegE 25    //bottom left
-#define SevenSegF 7     //Top Left
-#define SevenSegG 28    //Middle
-#define SevenSegDP 24   //decimal points
-
-//Function prototypes for HDC1080 API
-int readConfigReg();
-int readMFID();
-int readSN1();
-int readSN2();
-int readSN3();
-int readTemperature();
-int readHumidity();
+#include "hardware/structs/systick.h"
+#include "hardware/regs/m0plus.h"
+#include "hardware/irq.h"
+#include "pico/multicore.h"
+#endif
+
+//Hardware layer, pins, I2C, alarms and the clock used by the task code
+#include "hal.h"
+#include "board.h"
+
+//Drivers and services built on the hardware layer
+#include "hrtimer.h"
+#include "hdc1080.h"
+#include "step_engine.h"
+#include "seg_display.h"
+#include "latency_hist.h"
+#include "task_stream.h"
+
+//time between sensor acquisitions
+#define HDC1080_SAMPLE_MS 500
+
+//Core layout. With RT_IO_CORE set to 1 the step engine and display
+//scan run from alarm interrupts on core 1, away from USB, I2C and the
+//RTOS on core 0. Set it to 0 to run everything on core 0. The host
+//build has a single core.
+#ifdef HAL_HOST
+#define RT_IO_CORE 0
+#else
+#define RT_IO_CORE 1
+#endif
+
+//hardware alarm used by the core 1 alarm pool, the SDK default pool
+//on core 0 uses alarm 3
+#define IO_CORE_HW_ALARM 2
+#define IO_CORE_MAX_TIMERS 4
+
+//Commands sent from core 0 to the I/O core through the SIO FIFO
+typedef enum {
+    IO_CMD_STEP_START,      //start the move set up by motionMove()
+    IO_CMD_STEP_ENERGIZE,   //energize the coils for the current phase
+    IO_CMD_STEP_RELEASE,    //de-energize all coils
+    IO_CMD_SCAN_START,      //start the display scan
+    IO_CMD_SCAN_STOP        //stop the display scan and blank it
+} IoCommand;
+
+//Events sent from the I/O core back to core 0
+#define IO_EVT_STEP_DONE 1
+
+//task notification index used by hrSleepUs(), index 0 is used by the
+//step engine and the buttons
+#define HRTIMER_NOTIFY_INDEX 1
+
+//Motion command queue
+#define MOTION_QUEUE_LEN 8
+//task notification index used for motion command completion
+#define MOTION_NOTIFY_INDEX 2
+
+//maximum step rate set from the console, changed MOTION_SPEED_STEP
+//steps per second at a time. The step engine holds each drive mode to
+//its own limit, see STEP_RATE_LIMIT_FULL.
+#define MOTION_SPEED_STEP 100
+
+//time the test rotation holds at the far end before turning back, ms
+#define MOTION_TEST_HOLD_MS 500
+
+//Commands accepted by the motion task
+typedef enum {
+    MOTION_MOVE_REL,    //move arg half steps on from where the last move ended
+    MOTION_MOVE_ABS,    //move to absolute position arg, in half steps
+    MOTION_SET_SPEED,   //set the maximum step rate to arg steps per second
+    MOTION_SET_MODE,    //drive the following moves in StepMode arg
+    MOTION_HOLD         //keep the coils energized for arg ms before the next command
+} MotionOp;
+
+typedef struct {
+    MotionOp op;
+    int32_t arg;
+    uint32_t stopGen;       //motionStopGen when queued
+    TaskHandle_t notify;    //task to notify when done, or NULL
+} MotionCmd;
+
+//Motor status codes, shown on the 7 segment display as two letters
+#define MOTOR_STATUS_NONE 0
+#define MOTOR_STATUS_TEMP 994       //moving on temperature
+#define MOTOR_STATUS_HUM 995        //moving on humidity
+#define MOTOR_STATUS_CW 996         //clockwise
+#define MOTOR_STATUS_CCW 997        //counter-clockwise
+#define MOTOR_STATUS_TEST 998       //test rotation
+#define MOTOR_STATUS_ESTOP 999      //emergency stop
+
+//shown in place of a reading while the HDC1080 is not set up, as Er
+#define SENSOR_STATUS_ERROR 992
+
+//CPU usage sampling. Every CPU_STATS_PERIOD_MS the run time counters
+//are sampled, and usage is reported over the last CPU_STATS_WINDOW
+//periods.
+#define CPU_STATS_PERIOD_MS 1000
+#define CPU_STATS_WINDOW 5
+#define CPU_STATS_MAX_TASKS 12
+
+//Stack size suggestions keep the deepest use seen plus STACK_MARGIN_PCT
+//percent, but never less than STACK_MIN_SPARE words spare, rounded up
+//to STACK_ROUND words.
+#define STACK_MARGIN_PCT 25
+#define STACK_MIN_SPARE 32
+#define STACK_ROUND 8
+
+//Trace recorder ring, in events. Must be a power of two.
+#define TRACE_LEN 1024
+
+//Button gesture timing
+#define BUTTON_DEBOUNCE_US 20000        //edges closer than this are bounce
+#define BUTTON_GESTURE_TIMEOUT_MS 250   //quiet time after a release that ends a gesture
+#define BUTTON_LONG_PRESS_MS 800        //hold time for a long press
+#define BUTTON_RESYNC_MS 50             //pin level check while a button is held
+#define BUTTON_MAX_PRESSES 3            //a gesture ends as soon as it reaches this count
+#define BUTTON_EVENT_QUEUE_LEN 16       //power of two
+
+//Function prototypes for the I/O core
+void ioCoreInit();
+void ioCoreSend(IoCommand cmd);
+static void ioCoreRun(IoCommand cmd);
+static void ioCoreStepDone();
+
+//Latest sensor reading and motor status, published with a sequence
+//counter so readers never block
+typedef struct {
+    HDC1080Reading reading;
+    int motorStatus;            //one of the MOTOR_STATUS_ codes
+    uint64_t timestampUs;       //time of the reading, 0 before the first one
+} SensorSnapshot;
 
 //Function prototypes for Step Motor API
+void stepMotorRelease();
+bool motionSubmit(MotionOp op, int32_t arg);
+bool motionSubmitNotify(MotionOp op, int32_t arg);
+uint32_t motionTakeDone(TickType_t wait);
+void motionStop();
+int32_t motionPosition();
 void rotateCW();
 void rotateCCW();
 void fullRotateFB();
 void rotateOnTemp();
 void rotateOnHum();
 void emergencyStop();
-void smStatus(int status);
 
-//task list
+//task list and CPU usage
+typedef struct {
+    const char *name;
+    uint32_t permille;      //share of the window in tenths of a percent
+} CpuTaskStat;
+
+//task snapshot frames carry whole task names, see task_stream.h
+#if configMAX_TASK_NAME_LEN != TASK_STREAM_NAME_LEN
+#error "TASK_STREAM_NAME_LEN must match configMAX_TASK_NAME_LEN"
+#endif
+
+UBaseType_t taskSnapshot(TaskStatus_t *tasks, UBaseType_t maxTasks);
 void listTasks();
+void streamTasks();
+void cpuStatsInit();
+int cpuStatsGet(CpuTaskStat *stats, int maxStats);
+void cpuStatsPrint();
+
+//low power idle, vApplicationSleep() is declared in FreeRTOSConfig.h
+void lowPowerPrint();
 
 //Function prototypes for buttons API
-void getButtons();
+typedef struct {
+    uint8_t button;     //0-2 for S1-S3
+    bool pressed;       //true on press, false on release
+    uint32_t timeUs;    //time of the edge
+} ButtonEvent;
+
+void buttonsInit(TaskHandle_t task);
+static bool buttonEventPop(ButtonEvent *event);
+static void gestureEvent(const ButtonEvent *event);
+static TickType_t gestureTick(uint32_t now);
 
 //Task Prototypes
+static bool sensorSetup();
+void sensorPrintIdentity();
 void readHDC1080Task();
 void stepMotorTask();
 void buttonsTask();
-void segLEDLeft();
-void segLEDRight();
-
-//Define Queue variable to hold humidity and temp values
-QueueHandle_t mainControlQueue;
-QueueHandle_t smButtonQueue;
-QueueHandle_t sevSegDisQueue;
-QueueHandle_t tempMotQueue;
-
-//Define semaphore for 7segLEDs
-SemaphoreHandle_t ledSem;
-SemaphoreHandle_t i2cSem;
-SemaphoreHandle_t buttonSem;
-
-//Define Task handle, used to stop temp/hum sensor task in EE
-TaskHandle_t hdc1080;
-
-//buffer to vTaskList
-char TaskListPtr[250];
+void motionTask();
+void consoleTask();
+static void consoleRxReady(void *task);
+
+//Function prototypes for the sensor snapshot
+void snapshotPublishReading(const HDC1080Reading *reading, uint64_t timestampUs);
+void snapshotSetMotorStatus(int status);
+void snapshotRead(SensorSnapshot *snap);
+
+//Function prototypes for 7 segment LED API
+void segDisplayInit();
+void segDisplayGlyphs(uint8_t left, uint8_t right);
+void segDisplayValue(int value);
+void segDisplayReading(int value, uint64_t sourceUs);
+void segDisplaySetEnabled(bool enabled);
+
+//Every task with its stack depth in words and priority. The stack,
+//task control block and fnHandle of each are defined from this list.
+#define APP_TASKS(X)                \
+    X(readHDC1080Task, 256, 2)      \
+    X(stepMotorTask, 256, 2)        \
+    X(motionTask, 256, 2)           \
+    X(consoleTask, 256, 1)          \
+    X(buttonsTask, 256, 3)
+
+//Every queue with its length and item size, for button commands and
+//motor moves
+#define APP_QUEUES(X)                                   \
+    X(smButtonQueue, 2, sizeof(int))                    \
+    X(sevSegDisQueue, 2, sizeof(int))                   \
+    X(motionQueue, MOTION_QUEUE_LEN, sizeof(MotionCmd))
+
+//Stack depth actually given to a task. The POSIX port runs tasks on
+//host threads, which need more than the words sized for the Pico.
+#ifdef HAL_HOST
+#define APP_STACK_WORDS(words) \
+    ((words) > configMINIMAL_STACK_SIZE ? (words) : configMINIMAL_STACK_SIZE)
+#else
+#define APP_STACK_WORDS(words) (words)
+#endif
+
+//Define Task handles, stacks and control blocks
+#define TASK_STORAGE(fn, words, priority)                   \
+    static StackType_t fn##Stack[APP_STACK_WORDS(words)];   \
+    static StaticTask_t fn##TCB;                            \
+    TaskHandle_t fn##Handle;
+APP_TASKS(TASK_STORAGE)
+
+//Define Queue variables and their storage
+#define QUEUE_STORAGE(queue, length, itemSize)              \
+    static uint8_t queue##Storage[(length) * (itemSize)];   \
+    static StaticQueue_t queue##Struct;                     \
+    QueueHandle_t queue;
+APP_QUEUES(QUEUE_STORAGE)
+
+//Queue numbers for the trace recorder, 0 is left for kernel queues
+#define QUEUE_TRACE_ID(queue, length, itemSize) queue##Trace,
+enum { kernelQueueTrace, APP_QUEUES(QUEUE_TRACE_ID) };
+
+//memory map
+void memoryReport();
+
+//stack monitor
+void stackSample(const TaskStatus_t *tasks, UBaseType_t count);
+void stackReport();
+
+//trace recorder, traceRecord() is declared in FreeRTOSConfig.h
+void traceDump();
+
+//Latency from a sensor reading being taken to each place it is used
+typedef enum {
+    LAT_HANDOFF,        //handed to the display
+    LAT_DISPLAY,        //first scanned onto the display
+    LAT_MOTOR,          //picked up by a motor move
+    LAT_STAGES
+} LatencyStage;
+
+void latencyRecord(LatencyStage stage, uint64_t sourceUs);
+void latencyPrint();
+
+//step timing, recorded by the step engine
+void stepTimingPrint();
+
+//task snapshot for the console
+static TaskStatus_t consoleTasks[CPU_STATS_MAX_TASKS];
 
 //timer
 //static const TickType_t button_wait = 2000 / portTICK_PERIOD_MS;
 
 int main() {
-    // Enable UART so we can print status output
-  stdio_init_all();
-  while (!tud_cdc_connected()) { sleep_ms(100);  }    
-    
+    // Enable USB stdio so we can print status output
+    halConsoleInit();
+
     // This example will use I2C1 on the default SDA and SCL pins
-    i2c_init(I2C_PORT, 100 * 1000);
-    gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
-    gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(PICO_DEFAULT_I2C_SDA_PIN);
-    gpio_pull_up(PICO_DEFAULT_I2C_SCL_PIN);
+    halI2cInit(100 * 1000);
 
     //set up Button Pins
-    gpio_init(ButtonS1);
-    gpio_init(ButtonS2);
-    gpio_init(ButtonS3);
-
-    gpio_set_dir(ButtonS1, GPIO_IN);
-    gpio_set_dir(ButtonS2, GPIO_IN);
-    gpio_set_dir(ButtonS3, GPIO_IN);
+    halGpioInit(ButtonS1, false);
+    halGpioInit(ButtonS2, false);
+    halGpioInit(ButtonS3, false);
 
     //set up and init motor pins
-    gpio_init(StepMotorIN1);
-    gpio_init(StepMotorIN2);
-    gpio_init(StepMotorIN3);
-    gpio_init(StepMotorIN4);
+    halGpioInit(StepMotorIN1, true);
+    halGpioInit(StepMotorIN2, true);
+    halGpioInit(StepMotorIN3, true);
+    halGpioInit(StepMotorIN4, true);
 
-    gpio_set_dir(StepMotorIN1, GPIO_OUT);
-    gpio_set_dir(StepMotorIN2, GPIO_OUT);
-    gpio_set_dir(StepMotorIN3, GPIO_OUT);
-    gpio_set_dir(StepMotorIN4, GPIO_OUT);
+    //build the step engine speed ramp, moves end in ioCoreStepDone()
+    stepEngineInit(ioCoreStepDone);
 
     //set up and initialize 7SegLed pins
-    gpio_init(SevenSegA);   //top bar
-    gpio_init(SevenSegB);   //top right
-    gpio_init(SevenSegC);   //bottom right?
-    gpio_init(SevenSegD);   //bottom bar
-    gpio_init(SevenSegE);   //bottom left
-    gpio_init(SevenSegF);   //Top Left
-    gpio_init(SevenSegG);   //Middle
-    gpio_init(SevenSegDP);  //decimal points
-
-    gpio_init(SevenSegCC1); //right digit
-    gpio_init(SevenSegCC2); //left digit
-
-    gpio_set_dir(SevenSegA, GPIO_OUT);  //top bar
-    gpio_set_dir(SevenSegB, GPIO_OUT);  //top right
-    gpio_set_dir(SevenSegC, GPIO_OUT);  //bottom right?
-    gpio_set_dir(SevenSegD, GPIO_OUT);  //bottom bar
-    gpio_set_dir(SevenSegE, GPIO_OUT);  //bottom left
-    gpio_set_dir(SevenSegF, GPIO_OUT);  //Top Left
-    gpio_set_dir(SevenSegG, GPIO_OUT);  //Middle
-    gpio_set_dir(SevenSegDP, GPIO_OUT); //Decimal points
-
-    gpio_set_dir(SevenSegCC1, GPIO_OUT);    //right digit
-    gpio_set_dir(SevenSegCC2, GPIO_OUT);    //left digit
-
-    // Make the I2C pins available to picotool
-    bi_decl(bi_2pins_with_func(PICO_DEFAULT_I2C_SDA_PIN, PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C));
-
-    //initialize Semaphores
-    vSemaphoreCreateBinary(ledSem);
-    vSemaphoreCreateBinary(i2cSem);
-    vSemaphoreCreateBinary(buttonSem);
-    //buttonSem = xSemaphoreCreateMutex();
-
-    //initialize Queues
-    mainControlQueue = xQueueCreate(10, sizeof(int));
-    smButtonQueue = xQueueCreate(2, sizeof(int));
-    sevSegDisQueue = xQueueCreate(2, sizeof(int));
-    tempMotQueue = xQueueCreate(2, sizeof(int));
-    
-    //initialize task to read from HDC1080
-    xTaskCreate(readHDC1080Task, "readHDC1080Task", 256, NULL, 2, &hdc1080);
-    
-    //initialize task to control the step motor
-    xTaskCreate(stepMotorTask, "stepMotorTask", 256, NULL, 2, NULL);
-
-    //initialize task for button inputs
-    xTaskCreate(buttonsTask, "buttonsTask", 256, NULL, 3, NULL);
+    halGpioInit(SevenSegA, true);   //top bar
+    halGpioInit(SevenSegB, true);   //top right
+    halGpioInit(SevenSegC, true);   //bottom right?
+    halGpioInit(SevenSegD, true);   //bottom bar
+    halGpioInit(SevenSegE, true);   //bottom left
+    halGpioInit(SevenSegF, true);   //Top Left
+    halGpioInit(SevenSegG, true);   //Middle
+    halGpioInit(SevenSegDP, true);  //decimal points
+
+    halGpioInit(SevenSegCC1, true); //right digit
+    halGpioInit(SevenSegCC2, true); //left digit
+
+#ifdef PICO_DEFAULT_LED_PIN
+    //initialize on board LED
+    halGpioInit(PICO_DEFAULT_LED_PIN, true);
+#endif
+
+    //initialize Queues in their static storage
+#define QUEUE_CREATE(queue, length, itemSize)                                   \
+    queue = xQueueCreateStatic(length, itemSize, queue##Storage, &queue##Struct);   \
+    vQueueSetQueueNumber(queue, queue##Trace);
+    APP_QUEUES(QUEUE_CREATE)
+
+    //initialize the HDC1080, step motor, motion, console and button
+    //tasks on their static stacks
+#define TASK_CREATE(fn, words, priority) \
+    fn##Handle = xTaskCreateStatic(fn, #fn, APP_STACK_WORDS(words), NULL, priority, fn##Stack, &fn##TCB);
+    APP_TASKS(TASK_CREATE)
+
+    //start sampling per task CPU usage
+    cpuStatsInit();
+
+    //start the button edge interrupts
+    buttonsInit(buttonsTaskHandle);
  
-    //initialize tasks to display on 7 seg leds
-    xTaskCreate(segLEDLeft, "segLEDLeft", 128, NULL, 2, NULL);
-    xTaskCreate(segLEDRight, "segLEDRight", 128, NULL, 2, NULL);
+    //start core 1, then the timer driven 7 seg led scan on it
+    ioCoreInit();
+    segDisplayInit();
+
+    //print the RAM used by each kernel object
+    memoryReport();
 
     //start scheduler
     vTaskStartScheduler();
@@ -212,303 +372,368 @@ int main() {
   while(1){};
 }
 
+//Probe the HDC1080 and switch it to acquisition mode so one trigger
+//reads both values. Prints the identity once it succeeds. A failure is
+//printed only when it differs from the last attempt's, so retrying a
+//missing sensor every sample does not flood the console. Returns true
+//once the sensor is set up.
+static bool sensorSetup(){
+    static int lastStat;
+    HDC1080Device dev;
+    int probeStat;
+    int stat;
+
+    probeStat = hdc1080Probe(&dev);
+    stat = probeStat < 0 ? probeStat : hdc1080Init();
+
+    if(stat >= 0){
+        sensorPrintIdentity();
+    }
+    else if(stat != lastStat){
+        if(probeStat == HDC1080_ERROR_ID){
+            printf("Error: HDC1080 not found, Manufacturer ID = 0x%X Device ID = 0x%X\n", dev.mfID, dev.deviceID);
+        }
+        else if(probeStat < 0){
+            printf("Error: HDC1080 probe failed (%d)\n", probeStat);
+        }
+        else{
+            printf("Error: HDC1080 configuration failed (%d)\n", stat);
+        }
+        printf("Retrying every %d ms\n", HDC1080_SAMPLE_MS);
+    }
+
+    lastStat = stat;
+    return stat >= 0;
+}
+
+//Print the identity and serial number of the HDC1080 the driver found,
+//as read at its probe
+void sensorPrintIdentity(){
+    HDC1080Device dev;
+
+    if(!hdc1080Identity(&dev)){
+        printf("HDC1080 not found yet\n");
+        return;
+    }
+
+    printf("Configuration Register = 0x%X\n", dev.config);
+    printf("Manufacturer ID = 0x%X\n", dev.mfID);
+    printf("Device ID = 0x%X\n", dev.deviceID);
+    printf("Serial Number = %X-%X-%X\n", dev.serial[0], dev.serial[1], dev.serial[2]);
+}
+
 //This is the main task that reads the data from the HDC1080
 //and sends the data to a queue to display on 7-segment LEDs
 void readHDC1080Task() {
 
     //Initialize variables
-    int configStat;
-    int mfID;
-    int serialNum1;
-    int serialNum2;
-    int serialNum3;
-    int temperatureInC;
-    int temperatureInF;
-    int humidity;
-    int clearQueue;
-    int buttonSig;
+    bool sensorReady;
+    HDC1080Reading reading;
+    SensorSnapshot snap;
+    int buttonSig = 0;
+    const TickType_t samplePeriod = pdMS_TO_TICKS(HDC1080_SAMPLE_MS);
+    TickType_t lastSample;
+    TickType_t elapsed;
+    TickType_t wait;
     int sendTemp = 31;
     int sendHum = 32;
     int sendSM = 33;
-    int motStat;
-    int queueStat;
-    int overFlow = 993;
-
-    //Get Device ID values and print out on intial execution
-    configStat = readConfigReg();
-    mfID = readMFID();
-    serialNum1 = readSN1();
-    serialNum2 = readSN2();
-    serialNum3 = readSN3();
 
+    //Get Device ID values and print out on intial execution. Without a
+    //sensor there is nothing to show, so say so on the display.
+    sensorReady = sensorSetup();
+    if(!sensorReady){
+        segDisplayValue(SENSOR_STATUS_ERROR);
+    }
 
-    printf("Configuration Register = 0x%X\n", configStat);
-    printf("Manufacturer ID = 0x%X\n", mfID);
-    printf("Serial Number = %X-%X-%X\n", serialNum1, serialNum2, serialNum3);
+    lastSample = xTaskGetTickCount() - samplePeriod;
 
     while(true){
 
-        xSemaphoreTake(buttonSem, 1);
-        //printf("Sensor took Semaphore\n");
+        //sleep until a display command arrives or the next sample is due
+        elapsed = xTaskGetTickCount() - lastSample;
+        wait = elapsed >= samplePeriod ? 0 : samplePeriod - elapsed;
 
-        //Get current Temperature in C
-        temperatureInC = readTemperature();
+        if(xQueueReceive(sevSegDisQueue, &buttonSig, wait) != pdPASS){
+            lastSample = xTaskGetTickCount();
 
-        //Convert Temperature in C to F
-        temperatureInF = (temperatureInC * 1.8) + 32;
+            //keep trying to set the sensor up, once a sample
+            if(!sensorReady){
+                sensorReady = sensorSetup();
+            }
 
-        //Get current Humidity
-        humidity = readHumidity();
+            //Get current Temperature and Humidity from one acquisition and
+            //publish it, readers keep the last values if the read fails
+            if(sensorReady && readTempHumidity(&reading) >= 0){
+                snapshotPublishReading(&reading, halTimeUs64());
 
-        //print statements for temperature and humidity
-        //printf("Temperature in C: %d\n", temperatureInC);
-        //printf("Temperature in F: %d\n", temperatureInF);
-        //printf("Humidity %d\n", humidity);
+                //the motor task follows new readings in its sticky modes
+                xTaskNotifyGive(stepMotorTaskHandle);
+            }
+        }
 
-        xQueueReceive(sevSegDisQueue, &buttonSig, 0);
+        snapshotRead(&snap);
 
-        //if main control queue goes over 10 entries, display overflow
-        queueStat = uxQueueMessagesWaiting(mainControlQueue);
+        //hold EE on the display for the length of an emergency stop
+        if(snap.motorStatus != MOTOR_STATUS_ESTOP){
 
-        if(queueStat > 10){
-            xQueueSend(mainControlQueue, &overFlow, 0);
-            vTaskDelay(5000/portTICK_PERIOD_MS);
-            xQueueReset(mainControlQueue);
-        }
+            //there is no reading to show until the sensor is set up
+            if(!sensorReady && (buttonSig == sendHum || buttonSig == sendTemp)){
+                segDisplayValue(SENSOR_STATUS_ERROR);
+            }
 
-        if(buttonSig == sendHum){
-            //Send humidity data to queue and delay for 5 seconds
-            
-            xQueueSend(mainControlQueue, &humidity, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
-            
-            //check temp/hem queue for emergency stop
-            if(xQueuePeek(mainControlQueue, &clearQueue, 0)){
-                if(clearQueue == 999){
-                    buttonSig = 0;
-                    xSemaphoreGive(buttonSem);
-                    vTaskSuspend(NULL);
-                }
-                else{
-                    //clear Queue
-                    xQueueReceive(mainControlQueue, &clearQueue, 0);
-                }
+            //show humidity in whole percent
+            else if(buttonSig == sendHum){
+                segDisplayReading(centiRound(snap.reading.humidity100), snap.timestampUs);
             }
-        }
 
-        else if(buttonSig == sendTemp){
-            //send temperature data in F and delay for 5 seconds
-            xQueueSend(mainControlQueue, &temperatureInF, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
-
-            //check temp/hem queue for emergency stop
-            if(xQueuePeek(mainControlQueue, &clearQueue, 0)){
-                if(clearQueue == 999){
-                    buttonSig = 0;
-                    xSemaphoreGive(buttonSem);
-                    vTaskSuspend(NULL);
-                }
-                else{
-                    //clear Queue
-                    xQueueReceive(mainControlQueue, &clearQueue, 0);
-                }
+            //show temperature in whole degrees F
+            else if(buttonSig == sendTemp){
+                segDisplayReading(centiRound(snap.reading.tempF100), snap.timestampUs);
             }
-        }
 
-        //suspend task for motor task to post status to led segments
-        else if(buttonSig == sendSM){
+            //show the step motor status
+            else if(buttonSig == sendSM){
+                segDisplayValue(snap.motorStatus);
+            }
+        }
+    }
+}
 
-            xQueueReceive(tempMotQueue, &motStat, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
+//Task that decodes button gestures. Sleeps until the edge interrupt
+//posts an event or a gesture deadline passes.
+void buttonsTask(){
+    ButtonEvent event;
+    TickType_t wait = portMAX_DELAY;
 
-            xQueueSend(mainControlQueue, &motStat, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
+    while(true){
+        ulTaskNotifyTake(pdTRUE, wait);
 
-            //check temp/hem queue for emergency stop
-            if(xQueuePeek(mainControlQueue, &clearQueue, 0)){
-                if(clearQueue == 999){
-                    buttonSig = 0;
-                    xSemaphoreGive(buttonSem);
-                    vTaskSuspend(NULL);
-                }
-                else{
-                    //clear Queue
-                    xQueueReceive(mainControlQueue, &clearQueue, 0);
-                }
-            }
-            
+        while(buttonEventPop(&event)){
+            gestureEvent(&event);
         }
+        wait = gestureTick(halTimeUs32());
+    }
+}
+
+//////////////////////////////BUTTONS API START//////////////////////////////////////////////////////
 
-        xSemaphoreGive(buttonSem);
+//Button edges are captured by a GPIO interrupt and stamped with the
+//1 MHz timer. Events go through a single producer, single consumer
+//ring: the interrupt only writes buttonEventHead and buttonsTask only
+//writes buttonEventTail, so neither side needs a lock.
 
+static const unsigned buttonPins[3] = {ButtonS1, ButtonS2, ButtonS3};
 
+static ButtonEvent buttonEvents[BUTTON_EVENT_QUEUE_LEN];
+static volatile uint8_t buttonEventHead;
+static volatile uint8_t buttonEventTail;
+static TaskHandle_t buttonTaskHandle;
 
+//last accepted level and edge time per button, used for debouncing
+static bool buttonLevel[3];
+static uint32_t buttonEdgeUs[3];
+
+//GPIO edge interrupt. Accepts an edge when the level changed and the
+//last accepted edge on that button is older than BUTTON_DEBOUNCE_US.
+static void buttonIrqCallback(unsigned gpio){
+    BaseType_t woken = pdFALSE;
+    uint32_t now = halTimeUs32();
+    uint8_t head = buttonEventHead;
+    bool level;
+    int b;
+
+    for(b = 0; b < 3 && buttonPins[b] != gpio; b++){
+    }
+    if(b == 3){
+        return;
     }
-}
 
-//Task to run button function
-void buttonsTask(){
-    while(true){
+    level = halGpioGet(gpio);
+    if(level == buttonLevel[b] || now - buttonEdgeUs[b] < BUTTON_DEBOUNCE_US){
+        return;
+    }
+    buttonLevel[b] = level;
+    buttonEdgeUs[b] = now;
 
-        //take semaphore, run get buttons, release semaphore
-       // xSemaphoreTake(buttonSem, 1);
-        getButtons();
-        vTaskDelay(1/portTICK_PERIOD_MS);
-       // xSemaphoreGive(buttonSem);
+    //drop the event if the ring is full
+    if((uint8_t)(head - buttonEventTail) >= BUTTON_EVENT_QUEUE_LEN){
+        return;
     }
+    buttonEvents[head & (BUTTON_EVENT_QUEUE_LEN - 1)].button = b;
+    buttonEvents[head & (BUTTON_EVENT_QUEUE_LEN - 1)].pressed = level;
+    buttonEvents[head & (BUTTON_EVENT_QUEUE_LEN - 1)].timeUs = now;
+    halDmb();
+    buttonEventHead = head + 1;
+
+    vTaskNotifyGiveFromISR(buttonTaskHandle, &woken);
+    portYIELD_FROM_ISR(woken);
 }
 
-//////////////////////////////BUTTONS API START//////////////////////////////////////////////////////
-void getButtons(){
-
-    //set up variables to track which buttons are pressed
-    bool button1 = false;
-    bool button2 = false;
-    bool button3 = false;
-    bool b1WasPressed = false;
-    bool b2WasPressed = false;
-    bool b3WasPressed = false;
-
-    //set up counters for button press totals and timer
-    int button1Total = 0;
-    int button2Total = 0;
-    int button3Total = 0;
-    int buttonReturn = 0;
-    int buttonTimer = 0;
-    int buttonTimerMax = 200;
-    int bSend = 0;
-
-    while(buttonTimer < buttonTimerMax){
-        
-        button1 = gpio_get(ButtonS1);
-        button2 = gpio_get(ButtonS2);
-        button3 = gpio_get(ButtonS3);
-
-        //if button 1 is pressed, and not logged increment button 1 total and set
-        //b1WasPressed to true to log press
-        if(button1 == true && b1WasPressed == false){
-            button1Total += 1;
-            b1WasPressed = true;
-        }
-        //if button is not pressed, set log to false
-        else if(button1 == false){
-            b1WasPressed = false;
-        }
+//Take the oldest event off the ring, false if it is empty
+static bool buttonEventPop(ButtonEvent *event){
+    uint8_t tail = buttonEventTail;
 
-        //if button 1 is pressed, and not logged increment button 1 total and set
-        //b1WasPressed to true to log press
-        if(button2 == true && b2WasPressed == false){
-            button2Total += 1;
-            b2WasPressed = true;
-        }
-        //if button is not pressed, set log to false
-        else if(button2 == false){
-            b2WasPressed = false;
-        }
+    if(tail == buttonEventHead){
+        return false;
+    }
+    halDmb();
+    *event = buttonEvents[tail & (BUTTON_EVENT_QUEUE_LEN - 1)];
+    buttonEventTail = tail + 1;
 
-        //if button 1 is pressed, and not logged increment button 1 total and set
-        //b1WasPressed to true to log press
-        if(button3 == true && b3WasPressed == false){
-            button3Total += 1;
-            b3WasPressed = true;
-        }
-        //if button is not pressed, set log to false
-        else if(button3 == false){
-            b3WasPressed = false;
-        }
-        
+    return true;
+}
+
+//Enable the edge interrupts on the three buttons. buttonsTask must be
+//created first, it is the task the interrupt wakes.
+void buttonsInit(TaskHandle_t task){
+    buttonTaskHandle = task;
 
-            //delay and increment timing counter
-            vTaskDelay(10/portTICK_PERIOD_MS);
-            buttonTimer++;
+    for(int b = 0; b < 3; b++){
+        halGpioIrqEnable(buttonPins[b], buttonIrqCallback);
     }
+}
 
-    //Error check, only accept 1 button being pressed at at time
-    //button 1 baseline
-    if(button1Total > 0 && ((button2Total > 0 && button3Total > 0) || ((button2Total > 0) || (button3Total > 0)))){
+//Gesture state. A gesture starts with the first press and ends when
+//it is unambiguous: BUTTON_MAX_PRESSES presses, a long press, or
+//BUTTON_GESTURE_TIMEOUT_MS with every button released.
+typedef struct {
+    bool active;
+    bool reported;          //already acted on, waiting for release
+    bool chord;             //two buttons were down at once
+    uint8_t used;           //bit per button pressed in this gesture
+    uint8_t held;           //bit per button down now
+    uint8_t count[3];       //presses per button
+    uint32_t pressUs[3];    //time of the latest press per button
+    uint32_t lastEdgeUs;
+} ButtonGesture;
+
+static ButtonGesture gesture;
+
+//Act on a decoded gesture. A single button pressed 1-3 times sends the
+//same commands as before: button n pressed c times is n*10+c.
+static void gestureReport(int button, int count, bool longPress){
+    int bSend = (button + 1) * 10 + count;
+
+    if(gesture.chord || (gesture.used & (gesture.used - 1))){
         printf("Error: only press 1 button at a time\n");
-        button1Total = 0;
+        return;
     }
-    //button 2 baseline
-    else if(button2Total > 0 && ((button1Total > 0 && button3Total > 0) || ((button1Total > 0) || (button3Total > 0)))){
-        printf("Error: only press 1 button at a time\n");
-        button2Total = 0;
+    if(longPress){
+        printf("button%d long press\n", button + 1);
+        return;
     }
-    //button 3 baseline
-    else if(button3Total > 0 && ((button2Total > 0 && button1Total > 0) || ((button2Total > 0) || (button1Total > 0)))){
-        printf("Error: only press 1 button at a time\n");
-        button3Total = 0;
-    }
-    //don't accept any values over 3
-    else if(button1Total > 3 || button2Total > 3 || button3Total > 3){
-        printf("Error: button presses must be < 3 in 2 seconds\n");
-        buttonReturn = 0;
-    }
-    //valid button 1 pressed
-    else if(button1Total > 0){
-        printf("button1 pressed %d times\n", button1Total);
-        //move on temp
-        if(button1Total == 1){
-            bSend = 11;
-            xQueueSend(smButtonQueue, &bSend, 0);
-        }
-        //move on humidity
-        else if(button1Total == 2){
-            bSend = 12;
-            xQueueSend(smButtonQueue, &bSend, 0);
-        }
-        //emergency stop
-        else if(button1Total == 3){
-            bSend = 13;
-            xQueueSend(smButtonQueue, &bSend, 0);
-        }    
-    }
-    //valid button 2 pressed
-    else if(button2Total > 0){
-        printf("button2 pressed %d times\n", button2Total);
-        
-        //move motor CW
-        if(button2Total == 1){
-            bSend = 21;
-            xQueueSend(smButtonQueue, &bSend, 0);
-        }
-        //move motor CCW
-        else if(button2Total == 2){
-            bSend = 22;
-            xQueueSend(smButtonQueue, &bSend, 0);
-        }
-        //full CC CCW repeat
-        else if(button2Total == 3){
-            bSend = 23;
-            xQueueSend(smButtonQueue, &bSend, 0);
-        }
+
+    printf("button%d pressed %d times\n", button + 1, count);
+
+    //button 1 moves on temp/humidity or stops, button 2 moves the
+    //motor, button 3 picks what the display shows
+    if(button < 2){
+        xQueueSend(smButtonQueue, &bSend, 0);
+        xTaskNotifyGive(stepMotorTaskHandle);
+    }
+    else{
+        xQueueSend(sevSegDisQueue, &bSend, 0);
+    }
+}
+
+//index of the only button used in the gesture
+static int gestureButton(){
+    int b = 0;
+
+    while(b < 2 && !(gesture.used & (1u << b))){
+        b++;
+    }
+    return b;
+}
+
+//Feed one button edge into the gesture state
+static void gestureEvent(const ButtonEvent *event){
+    uint8_t bit = 1u << event->button;
+
+    gesture.lastEdgeUs = event->timeUs;
+
+    if(!event->pressed){
+        gesture.held &= ~bit;
+        return;
+    }
+
+    if(!gesture.active){
+        memset(&gesture, 0, sizeof(gesture));
+        gesture.active = true;
+        gesture.lastEdgeUs = event->timeUs;
     }
-    //valid button 3 pressed
-    else if(button3Total > 0){
-        printf("button3 pressed %d times\n", button3Total);
-        
-        //display temperature
-        if(button3Total == 1){
-            bSend = 31;
-            xQueueSend(sevSegDisQueue, &bSend, 0);
+    if(gesture.reported){
+        gesture.held |= bit;
+        return;
+    }
+
+    gesture.used |= bit;
+    gesture.held |= bit;
+    gesture.count[event->button]++;
+    gesture.pressUs[event->button] = event->timeUs;
+    if(gesture.held & (gesture.held - 1)){
+        gesture.chord = true;
+    }
+
+    //nothing can follow the last press count, act right away
+    if(!gesture.chord && gesture.count[event->button] >= BUTTON_MAX_PRESSES){
+        gestureReport(event->button, BUTTON_MAX_PRESSES, false);
+        gesture.reported = true;
+    }
+}
+
+//Check the gesture deadlines at time now. Returns how long buttonsTask
+//may sleep before the next deadline.
+static TickType_t gestureTick(uint32_t now){
+    uint32_t elapsedMs;
+    int b;
+
+    if(!gesture.active){
+        return portMAX_DELAY;
+    }
+
+    //catch a release whose edge was swallowed by the debounce window
+    for(b = 0; b < 3; b++){
+        if((gesture.held & (1u << b)) && !halGpioGet(buttonPins[b])){
+            gesture.held &= ~(1u << b);
+            gesture.lastEdgeUs = now;
         }
-        //display humidity
-        else if(button3Total == 2){
-            bSend = 32;
-            xQueueSend(sevSegDisQueue, &bSend, 0);
+    }
+
+    if(gesture.held != 0){
+        b = gestureButton();
+
+        //a single press still held long enough is a long press
+        if(!gesture.reported && gesture.held == gesture.used && !gesture.chord &&
+           gesture.count[b] == 1 &&
+           now - gesture.pressUs[b] >= BUTTON_LONG_PRESS_MS * 1000){
+            gestureReport(b, 1, true);
+            gesture.reported = true;
         }
-        //display step motor status
-        else if(button3Total == 3){
-            bSend = 33;
-            xQueueSend(sevSegDisQueue, &bSend, 0);
+        return pdMS_TO_TICKS(BUTTON_RESYNC_MS);
+    }
+
+    elapsedMs = (now - gesture.lastEdgeUs) / 1000;
+    if(gesture.reported || elapsedMs >= BUTTON_GESTURE_TIMEOUT_MS){
+        if(!gesture.reported){
+            b = gestureButton();
+            gestureReport(b, gesture.count[b], false);
         }
+        gesture.active = false;
+        return portMAX_DELAY;
     }
 
+    return pdMS_TO_TICKS(BUTTON_GESTURE_TIMEOUT_MS - elapsedMs) + 1;
 }
 //////////////////////////////BUTTONS API END//////////////////////////////////////////////////////
 
 
-//Step Motor Task that controls the how the step motor moves
+//Step Motor Task that controls the how the step motor moves. Button 1
+//pressed once or twice makes moving on temperature or humidity the
+//active mode, which stays until another motor command. The task sleeps
+//until the buttons task or readHDC1080Task notifies it, then runs any
+//queued commands and, in one of those modes, follows a new reading.
 void stepMotorTask(){
     //set up variables for how to move
     int buttonSig;
@@ -518,215 +743,348 @@ void stepMotorTask(){
     int moveCW = 21;
     int moveCCW = 22;
     int fullMove = 23;
-    
-    //motor status
-    int status;
+    int mode = 0;               //moveTemp, moveHum or 0 for none
+    bool picked;                //mode was picked by this wake up
+    uint64_t followedUs = 0;    //time of the last reading acted on
+    SensorSnapshot snap;
 
     while(true){
 
-        xSemaphoreTake(buttonSem, 1);
-        xQueueReceive(smButtonQueue, &buttonSig, 0);
+        //sleep until a button command or a new reading
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        picked = false;
 
-        //signals received from button 1
-        if(buttonSig == moveTemp){
-            status = 994;
-            xQueueSend(tempMotQueue, &status, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
-            rotateOnTemp();
-            xSemaphoreGive(buttonSem);
-        }
-        else if(buttonSig == moveHum){
-            status = 995;
-            xQueueSend(tempMotQueue, &status, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
-            rotateOnHum();
-            xSemaphoreGive(buttonSem);
+        while(xQueueReceive(smButtonQueue, &buttonSig, 0) == pdPASS){
+            mode = 0;
+
+            //signals received from button 1
+            if(buttonSig == moveTemp || buttonSig == moveHum){
+                mode = buttonSig;
+                picked = true;
+            }
+            else if(buttonSig == stopEE){
+                emergencyStop();
+
+                //resume test rotation
+                fullRotateFB();
+            }
+
+            //signals received from Button 2
+            else if(buttonSig == moveCW){
+                snapshotSetMotorStatus(MOTOR_STATUS_CW);
+                rotateCW();
+            }
+            else if(buttonSig == moveCCW){
+                snapshotSetMotorStatus(MOTOR_STATUS_CCW);
+                rotateCCW();
+            }
+            else if(buttonSig == fullMove){
+                fullRotateFB();
+            }
         }
-        else if(buttonSig == stopEE){
-            emergencyStop();
 
-            //resume test rotation
-            buttonSig = 23;
-            xSemaphoreGive(buttonSem);
+        //act on the current reading when the mode is picked, then on
+        //each new one as it is published
+        snapshotRead(&snap);
+        if(mode != 0 && (picked || snap.timestampUs != followedUs)){
+            if(!picked){
+                //time from a new reading to the motor acting on it
+                latencyRecord(LAT_MOTOR, snap.timestampUs);
+            }
+            followedUs = snap.timestampUs;
+
+            if(mode == moveTemp){
+                snapshotSetMotorStatus(MOTOR_STATUS_TEMP);
+                rotateOnTemp();
+            }
+            else{
+                snapshotSetMotorStatus(MOTOR_STATUS_HUM);
+                rotateOnHum();
+            }
         }
+    }
+}
+//////////////////////////////STEP MOTOR API START//////////////////////////////////////////////////////
+
+//Copy the state of every task into tasks. Returns the number of tasks,
+//or 0 if there are more than maxTasks. The scheduler is only suspended
+//while the kernel copies the task states, callers format afterwards.
+UBaseType_t taskSnapshot(TaskStatus_t *tasks, UBaseType_t maxTasks){
+    return uxTaskGetSystemState(tasks, maxTasks, NULL);
+}
+
+//Task list, followed by the CPU usage of each task
+void listTasks(){
+    static const char stateChar[] = {'X', 'R', 'B', 'S', 'D', 'I'};
+    UBaseType_t count = taskSnapshot(consoleTasks, CPU_STATS_MAX_TASKS);
+
+    if(count == 0){
+        printf("more than %d tasks\n", CPU_STATS_MAX_TASKS);
+    }
+
+    printf("task_n           task_s  priority  ss    tn\n");
+    for(UBaseType_t i = 0; i < count; i++){
+        TaskStatus_t *task = &consoleTasks[i];
+
+        printf("%-16s %c       %-8lu  %-5u %lu\n", task->pcTaskName, task->eCurrentState < sizeof(stateChar) ? stateChar[task->eCurrentState] : '?', (unsigned long)task->uxCurrentPriority, task->usStackHighWaterMark, (unsigned long)task->xTaskNumber);
+    }
+    printf("\n");
+    cpuStatsPrint();
+}
+
+//Write a binary task snapshot frame to the console, for tools/taskdump
+//to print. halConsolePutRaw() skips the stdio CR/LF translation so the
+//bytes arrive unchanged.
+void streamTasks(){
+    static TaskRecord records[CPU_STATS_MAX_TASKS];
+    static uint8_t frame[TASK_STREAM_OVERHEAD + sizeof(records)];
+    UBaseType_t count = taskSnapshot(consoleTasks, CPU_STATS_MAX_TASKS);
+    size_t len;
+
+    for(UBaseType_t i = 0; i < count; i++){
+        TaskStatus_t *task = &consoleTasks[i];
+        TaskRecord *record = &records[i];
+
+        memset(record, 0, sizeof(*record));
+        record->number = task->xTaskNumber;
+        record->state = task->eCurrentState;
+        record->priority = task->uxCurrentPriority;
+        record->basePriority = task->uxBasePriority;
+        record->stackFree = task->usStackHighWaterMark;
+        record->runTimeUs = task->ulRunTimeCounter;
+        strncpy(record->name, task->pcTaskName, sizeof(record->name));
+    }
+
+    len = taskStreamEncode(frame, sizeof(frame), records, count);
+    for(size_t b = 0; b < len; b++){
+        halConsolePutRaw(frame[b]);
+    }
+    halConsoleFlush();
+}
+//////////////////////////////////////////////
+//Step engine tasks side. The engine itself is in step_engine.c and
+//runs from a hardware alarm on the I/O core; these calls hand it moves
+//and wait for them to finish.
+//////////////////////////////////////////////
+
+//task blocked in motionMove(), woken when the move ends
+static TaskHandle_t stepWaiter;
+
+//de-energize all coils. Done on the I/O core so it is ordered after
+//any step already in flight there.
+void stepMotorRelease(){
+    ioCoreSend(IO_CMD_STEP_RELEASE);
+}
+
+//Wake the task waiting in motionMove(), from interrupt context on
+//core 0. Without RT_IO_CORE it is also called from motionTask itself,
+//through ioCoreSend(), when the step timer could not be started; the
+//notification is then taken by the wait that follows.
+static void stepEngineWake(){
+    BaseType_t woken = pdFALSE;
+
+    vTaskNotifyGiveFromISR(stepWaiter, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+//////////////////////////////////////////////
+//Motion command queue. Callers queue moves and return right away;
+//motionTask runs them one after another on the step engine, so the
+//next move can be queued while the current one runs.
+//////////////////////////////////////////////
 
-        //signals received from Button 2
-        else if(buttonSig == moveCW){
-            status = 996;
-            xQueueSend(tempMotQueue, &status, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
-            rotateCW();
-            xSemaphoreGive(buttonSem);
+//Bumped by motionStop(). Commands carry the value from when they were
+//queued, and moves and holds queued before the last stop are skipped.
+//Checking the count rather than emptying the queue also catches a
+//command motionTask had already taken off the queue but not started.
+static volatile uint32_t motionStopGen;
+
+//queue cmd with the current stop count
+static bool motionQueueCmd(MotionOp op, int32_t arg, TaskHandle_t notify){
+    MotionCmd cmd;
+
+    cmd.op = op;
+    cmd.arg = arg;
+    cmd.stopGen = motionStopGen;
+    cmd.notify = notify;
+
+    return xQueueSend(motionQueue, &cmd, 0) == pdPASS;
+}
+
+//Queue a motion command. Returns false if the queue is full.
+bool motionSubmit(MotionOp op, int32_t arg){
+    return motionQueueCmd(op, arg, NULL);
+}
+
+//Queue a motion command and have the calling task notified on
+//MOTION_NOTIFY_INDEX when it has finished, or has been skipped by
+//motionStop(), see motionTakeDone(). Returns false if the queue is full.
+bool motionSubmitNotify(MotionOp op, int32_t arg){
+    return motionQueueCmd(op, arg, xTaskGetCurrentTaskHandle());
+}
+
+//Number of commands the calling task queued with motionSubmitNotify()
+//that are done since the last call. Blocks up to wait for the first.
+uint32_t motionTakeDone(TickType_t wait){
+    return ulTaskNotifyTakeIndexed(MOTION_NOTIFY_INDEX, pdTRUE, wait);
+}
+
+//Stop the running move at the next step, skip every queued move and
+//hold, and de-energize the coils. Takes effect immediately rather than
+//waiting its turn in the queue.
+void motionStop(){
+    taskENTER_CRITICAL();
+    motionStopGen++;
+    stepEngineStop();
+    taskEXIT_CRITICAL();
+
+    stepMotorRelease();
+}
+
+//current absolute position in half steps, positive is clockwise
+int32_t motionPosition(){
+    return stepEnginePosition();
+}
+
+//Run a MOTION_MOVE_REL or MOTION_MOVE_ABS command and block until the
+//move is finished or stopped. A relative move is turned into a target
+//here, when it starts, so it is taken from wherever the moves queued
+//ahead of it left the motor. The stop count is checked and the move
+//loaded in one critical section, so a motionStop() either lands before
+//and the move is skipped, or after and stops it.
+static void motionMove(const MotionCmd *cmd){
+    bool loaded;
+
+    stepWaiter = xTaskGetCurrentTaskHandle();
+
+    taskENTER_CRITICAL();
+    loaded = cmd->stopGen == motionStopGen &&
+             stepEngineLoadTo(cmd->op == MOTION_MOVE_ABS ? cmd->arg : stepEnginePosition() + cmd->arg);
+    taskEXIT_CRITICAL();
+
+    if(!loaded){
+        return;
+    }
+
+    ioCoreSend(IO_CMD_STEP_START);
+
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+//Task that takes commands off motionQueue and runs them. Speed and mode
+//changes are only made here, between moves, so the ramp table is never
+//rebuilt under a running move. They are not skipped after a stop, so
+//the moves queued after them still run in the speed and mode they
+//asked for. A mode change leaves the position alone: it is kept in half
+//steps in every mode and moves are given in half steps, so the same
+//target is the same place whatever mode reaches it. Each command,
+//skipped or not, notifies the task that asked for it when it is done.
+void motionTask(){
+    MotionCmd cmd;
+
+    while(true){
+        xQueueReceive(motionQueue, &cmd, portMAX_DELAY);
+
+        if(cmd.op == MOTION_MOVE_REL || cmd.op == MOTION_MOVE_ABS){
+            motionMove(&cmd);
         }
-        else if(buttonSig == moveCCW){
-            status = 997;
-            xQueueSend(tempMotQueue, &status, 0);
-            vTaskDelay(10/portTICK_PERIOD_MS);
-            rotateCCW();
-            xSemaphoreGive(buttonSem);
+        else if(cmd.op == MOTION_SET_SPEED){
+            stepEngineSetProfile(STEP_START_RATE, cmd.arg, STEP_ACCEL);
         }
-        else if(buttonSig == fullMove){
-            fullRotateFB();
-            xSemaphoreGive(buttonSem);
+        else if(cmd.op == MOTION_SET_MODE){
+            stepEngineSetMode(cmd.arg);
+        }
+        else if(cmd.op == MOTION_HOLD && cmd.stopGen == motionStopGen){
+            ioCoreSend(IO_CMD_STEP_ENERGIZE);
+            vTaskDelay(cmd.arg/portTICK_PERIOD_MS);
         }
 
-        //signal received from Button 3
-        /*else if(buttonSig == 33){
-            smStatus(status);
-            xSemaphoreGive(buttonSem);
-
-        }*/
-        //if no button signal received, give up semaphore
-        else{
-            xSemaphoreGive(buttonSem);
+        if(cmd.notify != NULL){
+            xTaskNotifyGiveIndexed(cmd.notify, MOTION_NOTIFY_INDEX);
         }
+    }
+}
+
+//Commands stepMotorTask has queued that motionTask has not finished.
+//Only stepMotorTask queues through motorSubmit(), so only it counts.
+static uint32_t motorPending;
 
-        
+//drive mode of the last MOTION_SET_MODE stepMotorTask queued
+static StepMode motorMode = STEP_DRIVE_MODE;
+
+//queue a command from the Step Motor API, counted until it is done.
+//Returns false if the queue is full.
+static bool motorSubmit(MotionOp op, int32_t arg){
+    if(!motionSubmitNotify(op, arg)){
+        return false;
     }
+    motorPending++;
+    return true;
 }
-//////////////////////////////STEP MOTOR API START//////////////////////////////////////////////////////
 
-//vTaskList function
-void listTasks(){
-    vTaskList(TaskListPtr);
-    printf("task_n   task_s  priority        ss     tn\n");
-    printf("%s\n", TaskListPtr);
+//queue a mode change ahead of the next move, if it needs one
+static void motorSetMode(StepMode mode){
+    if(mode != motorMode && motorSubmit(MOTION_SET_MODE, mode)){
+        motorMode = mode;
+    }
+}
+
+//true once every command queued through motorSubmit() is done
+static bool motorSettled(){
+    motorPending -= motionTakeDone(0);
+    return motorPending == 0;
 }
-//Function in the Step Motor API to rotate clockwise
+
+//Function in the Step Motor API to rotate clockwise. A short jog with
+//no load to speak of, so it runs in wave drive, one coil at a time.
 void rotateCW(){
-    //////////////////////////////////////////////
-    //steps for clockwise direction, full step
-    // #step    1   2   3   4
-    //          --------------
-    //
-    //pin13     1   1   0   0
-    //pin12     0   1   1   0
-    //pin9      0   0   1   1
-    //pin6      1   0   0   1
-    //////////////////////////////////////////////
-
-
-    //step 1
-    gpio_put(StepMotorIN1, 1);
-    gpio_put(StepMotorIN2, 0);
-    gpio_put(StepMotorIN3, 0);
-    gpio_put(StepMotorIN4, 1);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-
-    //step 2
-    gpio_put(StepMotorIN1, 1);
-    gpio_put(StepMotorIN2, 1);
-    gpio_put(StepMotorIN3, 0);
-    gpio_put(StepMotorIN4, 0);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-
-    //step 3
-    gpio_put(StepMotorIN1, 0);
-    gpio_put(StepMotorIN2, 1);
-    gpio_put(StepMotorIN3, 1);
-    gpio_put(StepMotorIN4, 0);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-
-    //step 4
-    gpio_put(StepMotorIN1, 0);
-    gpio_put(StepMotorIN2, 0);
-    gpio_put(StepMotorIN3, 1);
-    gpio_put(StepMotorIN4, 1);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-
-}
-
-//Function to move the step motor in counter clockwise direction
+    motorSetMode(STEP_MODE_WAVE);
+    motorSubmit(MOTION_MOVE_REL, STEPS_PER_ROTATE * 2);
+}
+
+//Function to move the step motor in counter clockwise direction, in
+//wave drive like rotateCW()
 void rotateCCW(){
-        //////////////////////////////////////////////
-    //steps for counter-clockwise direction, full step
-    // #step    1   2   3   4
-    //          --------------
-    //
-    //pin13     0   0   1   1
-    //pin12     0   1   1   0
-    //pin9      1   1   0   0
-    //pin6      1   0   0   1
-    //////////////////////////////////////////////
-
-    //step 1
-    gpio_put(StepMotorIN1, 0);
-    gpio_put(StepMotorIN2, 0);
-    gpio_put(StepMotorIN3, 1);
-    gpio_put(StepMotorIN4, 1);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-
-    //step 2
-    gpio_put(StepMotorIN1, 0);
-    gpio_put(StepMotorIN2, 1);
-    gpio_put(StepMotorIN3, 1);
-    gpio_put(StepMotorIN4, 0);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-
-    //step 3
-    gpio_put(StepMotorIN1, 1);
-    gpio_put(StepMotorIN2, 1);
-    gpio_put(StepMotorIN3, 0);
-    gpio_put(StepMotorIN4, 0);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-
-    //step 4
-    gpio_put(StepMotorIN1, 1);
-    gpio_put(StepMotorIN2, 0);
-    gpio_put(StepMotorIN3, 0);
-    gpio_put(StepMotorIN4, 1);
-    vTaskDelay(10/portTICK_PERIOD_MS);
-}
-
-//Function to rotate 1 the step motor one full revolution clockwise
-//and then 1 full revolution counter clockwise
+    motorSetMode(STEP_MODE_WAVE);
+    motorSubmit(MOTION_MOVE_REL, -STEPS_PER_ROTATE * 2);
+}
+
+//Function to rotate 1 the step motor one full revolution clockwise,
+//hold there, and then turn back to where the rotation began. Both
+//moves are relative, so the way back starts from wherever the moves
+//queued ahead of this one leave the motor.
 void fullRotateFB(){
 
     int max_steps = 500;
-    int status;
-    int clearQueue;
+    int32_t halfSteps = (max_steps + 1) * STEPS_PER_ROTATE * 2;
 
-    //clear previous status
-    xQueueReceive(tempMotQueue, &clearQueue, 0);
-    vTaskDelay(10/portTICK_PERIOD_MS);
+    snapshotSetMotorStatus(MOTOR_STATUS_TEST);
 
-    status = 998;
-    xQueueSend(tempMotQueue, &status, 0);
-    vTaskDelay(200/portTICK_PERIOD_MS);
+    //the long test rotation runs at full torque
+    motorSetMode(STEP_MODE_FULL);
 
     //one full rotation clockwise
-    for(int i = 0; i <= max_steps; i++){
-        //check for emergency stop
-        rotateCW();
-    }
+    motorSubmit(MOTION_MOVE_REL, halfSteps);
 
-    //one full rotation counter-clockwise
-    for(int i = 0; i <= max_steps; i++){
-        rotateCCW();
-    }
-
-    //delay for 10 seconds
-    //vTaskDelay(1000/portTICK_PERIOD_MS);
+    motorSubmit(MOTION_HOLD, MOTION_TEST_HOLD_MS);
 
+    //back to the start counter-clockwise
+    motorSubmit(MOTION_MOVE_REL, -halfSteps);
 }
 
-//Function that rotates on changes in temperature
+//Function that rotates on changes in temperature, in half steps for
+//the finest dial. STEPS_PER_ROTATE half steps per degree.
 void rotateOnTemp(){
     int currentTemp;
-    int tempCheck;
+    SensorSnapshot snap;
     static int prevTemp;
     int numSteps = 0;
 
-    //look at mainControlQueue and get a copy of the current value
-    if(xQueuePeek(mainControlQueue, &tempCheck, 0)){
+    //get a copy of the latest reading, if there has been one
+    snapshotRead(&snap);
+    if(snap.timestampUs != 0){
 
-        //ignore motor status numbers
-        if(tempCheck < 992){
-            currentTemp = tempCheck;
-        }
-        else{
-            currentTemp = prevTemp;
-        }
+        currentTemp = centiRound(snap.reading.tempF100);
 
         //check if previous temp or current temp is larger
         //current Temp is larger, move clockswise for x steps
@@ -736,9 +1094,8 @@ void rotateOnTemp(){
 
             prevTemp = currentTemp;
 
-            for(int i = 0; i < numSteps; i++){
-                rotateCW();
-            }
+            motorSetMode(STEP_MODE_HALF);
+            motorSubmit(MOTION_MOVE_REL, numSteps * STEPS_PER_ROTATE);
         }
 
         //if temp decreasing, rotate ccw for x steps
@@ -747,37 +1104,26 @@ void rotateOnTemp(){
 
             prevTemp = currentTemp;
 
-            for(int i = 0; i < numSteps; i++){
-                rotateCCW();
-            }
-        }
-        //if no change, delay
-        else{
-            //xSemaphoreGive(buttonSem);
-            vTaskDelay(2000/portTICK_PERIOD_MS);
-            //xSemaphoreTake(buttonSem, 0);
+            motorSetMode(STEP_MODE_HALF);
+            motorSubmit(MOTION_MOVE_REL, -numSteps * STEPS_PER_ROTATE);
         }
     }
 
 }
 
-//Function that rotates motor on changes in humidity
+//Function that rotates motor on changes in humidity, in half steps
+//like rotateOnTemp(). STEPS_PER_ROTATE half steps per percent.
 void rotateOnHum(){
     int currentHum;
-    int humCheck;
+    SensorSnapshot snap;
     static int prevHum;
     int numSteps = 0;
 
-    //look at mainControlQueue and get a copy of the current value
-    if(xQueuePeek(mainControlQueue, &humCheck, 0)){
+    //get a copy of the latest reading, if there has been one
+    snapshotRead(&snap);
+    if(snap.timestampUs != 0){
 
-        //ignore motor status numbers
-        if(humCheck < 992){
-            currentHum = humCheck;
-        }
-        else{
-            currentHum = prevHum;
-        }
+        currentHum = centiRound(snap.reading.humidity100);
 
         //check if previous temp or current temp is larger
         //current Temp is larger, move clockswise for x steps
@@ -787,9 +1133,8 @@ void rotateOnHum(){
 
             prevHum = currentHum;
 
-            for(int i = 0; i < numSteps; i++){
-                rotateCW();
-            }
+            motorSetMode(STEP_MODE_HALF);
+            motorSubmit(MOTION_MOVE_REL, numSteps * STEPS_PER_ROTATE);
         }
 
         //if temp decreasing, rotate ccw for x steps
@@ -798,19 +1143,12 @@ void rotateOnHum(){
 
             prevHum = currentHum;
 
-            for(int i = 0; i < numSteps; i++){
-                rotateCCW();
-            }
+            motorSetMode(STEP_MODE_HALF);
+            motorSubmit(MOTION_MOVE_REL, -numSteps * STEPS_PER_ROTATE);
         }
-        //if no change, delay
-        else{
-            gpio_put(StepMotorIN1, 0);
-            gpio_put(StepMotorIN2, 0);
-            gpio_put(StepMotorIN3, 0);
-            gpio_put(StepMotorIN4, 0);
-            //xSemaphoreGive(buttonSem);
-            vTaskDelay(2000/portTICK_PERIOD_MS);
-            //xSemaphoreTake(buttonSem, 0);
+        //if no change and the moves asked for are done, let the coils go
+        else if(motorSettled()){
+            stepMotorRelease();
         }
     }
 }
@@ -818,994 +1156,866 @@ void rotateOnHum(){
 //Function to stop motor, display EE to 7 seg
 void emergencyStop(){
 
-    //intitialize variables
-    int stop = 999;
-    int clearQueue;
-    int status;
-
-    //send signal to 7 seg display
-    xQueueSend(mainControlQueue, &stop, 0);
+    //show EE, readHDC1080Task leaves the display alone while the
+    //status is MOTOR_STATUS_ESTOP
+    snapshotSetMotorStatus(MOTOR_STATUS_ESTOP);
+    segDisplayValue(MOTOR_STATUS_ESTOP);
 
-    //stop motor for 5 seconds
-    gpio_put(StepMotorIN1, 0);
-    gpio_put(StepMotorIN2, 0);
-    gpio_put(StepMotorIN3, 0);
-    gpio_put(StepMotorIN4, 0);
+    //stop motor and drop queued moves for 5 seconds
+    motionStop();
 
     vTaskDelay(5000/portTICK_PERIOD_MS);
 
-    //resume readHDC1080 task
-    vTaskResume(hdc1080);
-
-    //clear message from queue
-    xQueueReceive(mainControlQueue, &clearQueue, 0);
-
     //send test status
-    status = 998;
-    xQueueSend(tempMotQueue, &status, 0);
-    vTaskDelay(200/portTICK_PERIOD_MS);
-    
+    snapshotSetMotorStatus(MOTOR_STATUS_TEST);
 }
 
 //////////////////////////////STEP MOTOR API END//////////////////////////////////////////////////////
 
-//////////////////////////////HDC1080 API START//////////////////////////////////////////////////////
 
-//Function to read a return the Configuration Register Status
-//Value will be printed once at the beginning of the
-//readHDC1080Task  task
-int readConfigReg(){
+//////////////////////////////CONSOLE API START//////////////////////////////////////////////////////
 
-    uint8_t cfReg[2];    
-    uint8_t cfRegVal = HDC1080CONFIGREG;
+//Wake the console task, from the interrupt that saw characters arrive
+static void consoleRxReady(void *task){
+    BaseType_t woken = pdFALSE;
 
-    int ret;
+    vTaskNotifyGiveFromISR(task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
 
-      //write blocking for Configuration Register
-      ret = i2c_write_blocking(I2C_PORT, HDC1080ADDRESS, &cfRegVal, 1, false);
-      vTaskDelay(100/portTICK_PERIOD_MS);
+//Task that handles single character commands from the USB console.
+//It sleeps until characters arrive rather than polling, so it adds no
+//wakeups to the idle sleep. Low priority, so it only runs when nothing
+//else needs the core.
+void consoleTask(){
+    int c;
+    bool displayOn = true;
+    int32_t maxRate = STEP_MAX_RATE;
 
-      //read blocking. Read Configuration Register
-      ret = i2c_read_blocking(I2C_PORT, HDC1080ADDRESS, cfReg, 2, false);
-      int fullcfReg = cfReg[0]<<8|cfReg[1];
+    halConsoleSetRxCallback(consoleRxReady, xTaskGetCurrentTaskHandle());
 
-      return fullcfReg;
+    while(true){
+        //handle everything waiting, typed before the callback was set
+        //up included
+        while((c = halConsoleGetChar()) != HAL_CONSOLE_NONE){
 
-}
+            //t: task list and CPU usage
+            if(c == 't'){
+                listTasks();
+            }
+            //s: time spent asleep in idle and how long the sleeps are
+            else if(c == 's'){
+                lowPowerPrint();
+            }
+            //m: RAM used by each kernel object
+            else if(c == 'm'){
+                memoryReport();
+            }
+            //k: stack use of each task and a suggested size
+            else if(c == 'k'){
+                stackReport();
+            }
+            //b: binary task snapshot frame
+            else if(c == 'b'){
+                streamTasks();
+            }
+            //r: binary trace frame, for tools/tracedump
+            else if(c == 'r'){
+                traceDump();
+            }
+            //i: HDC1080 identity and serial number
+            else if(c == 'i'){
+                sensorPrintIdentity();
+            }
+            //l: sensor to display and motor latency
+            else if(c == 'l'){
+                latencyPrint();
+            }
+            //j: step interval jitter and missed step deadlines
+            else if(c == 'j'){
+                stepTimingPrint();
+            }
+            //d: blank or restore the display, a blank display stops the
+            //scan interrupt so the core can sleep longer
+            else if(c == 'd'){
+                displayOn = !displayOn;
+                segDisplaySetEnabled(displayOn);
+            }
+            //+ and -: raise or lower the maximum step rate, from the next
+            //move, up to the limit of the fastest drive mode
+            else if(c == '+' || c == '-'){
+                maxRate += c == '+' ? MOTION_SPEED_STEP : -MOTION_SPEED_STEP;
+                if(maxRate < STEP_START_RATE){
+                    maxRate = STEP_START_RATE;
+                }
+                if(maxRate > STEP_RATE_LIMIT_HALF){
+                    maxRate = STEP_RATE_LIMIT_HALF;
+                }
+                if(motionSubmit(MOTION_SET_SPEED, maxRate)){
+                    printf("max step rate %ld steps/s", (long)maxRate);
+                    if(maxRate > STEP_RATE_LIMIT_FULL){
+                        printf(", %d in full and wave drive", STEP_RATE_LIMIT_FULL);
+                    }
+                    printf("\n");
+                }
+            }
+        }
 
-//Function to read and return the Manufacturing ID
-//Value will be printed once at the beginning of the
-//readHDC1080Task  task
-int readMFID(){
+        //Sleep until more arrive. A notification taken here may be for
+        //characters already read above, then the pass finds nothing.
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
 
-      uint8_t manufactID[2];
-      uint8_t mfVal = HDC1080DEVICEIDREG;
-      int ret;
+//Run time stats clock for FreeRTOS, the 1 MHz timer
+unsigned long runTimeCounter(){
+    return halTimeUs32();
+}
 
-      //write blocking for MF ID
-      ret = i2c_write_blocking(I2C_PORT, HDC1080ADDRESS, &mfVal, 1, false);
-      vTaskDelay(100/portTICK_PERIOD_MS);
+//Run time counters of every task at the end of each of the last
+//CPU_STATS_WINDOW periods, plus the current one. Tasks are indexed by
+//their task number, which FreeRTOS hands out in creation order.
+static uint32_t cpuStatsTime[CPU_STATS_WINDOW + 1];
+static uint32_t cpuStatsRun[CPU_STATS_WINDOW + 1][CPU_STATS_MAX_TASKS];
+static const char *cpuStatsName[CPU_STATS_MAX_TASKS];
+static uint8_t cpuStatsSlot;
+static uint8_t cpuStatsFilled;
+static TaskStatus_t cpuStatsTasks[CPU_STATS_MAX_TASKS];
+static TimerHandle_t cpuStatsTimer;
+static StaticTimer_t cpuStatsTimerBuffer;
+
+//Timer callback, stores the run time counters for this period
+static void cpuStatsSample(TimerHandle_t timer){
+    UBaseType_t count;
+    uint32_t total;
+
+    cpuStatsSlot = (cpuStatsSlot + 1) % (CPU_STATS_WINDOW + 1);
+    count = uxTaskGetSystemState(cpuStatsTasks, CPU_STATS_MAX_TASKS, &total);
+
+    cpuStatsTime[cpuStatsSlot] = runTimeCounter();
+    for(UBaseType_t i = 0; i < count; i++){
+        UBaseType_t n = cpuStatsTasks[i].xTaskNumber;
+
+        if(n < CPU_STATS_MAX_TASKS){
+            cpuStatsRun[cpuStatsSlot][n] = cpuStatsTasks[i].ulRunTimeCounter;
+            cpuStatsName[n] = cpuStatsTasks[i].pcTaskName;
+        }
+    }
 
-      //read blocking. Return Full Manufacturing ID
-      ret = i2c_read_blocking(I2C_PORT, HDC1080ADDRESS, manufactID, 2, false);
-      int fullMfID = manufactID[0]<<8|manufactID[1];
+    stackSample(cpuStatsTasks, count);
 
-      return fullMfID;
+    if(cpuStatsFilled < CPU_STATS_WINDOW){
+        cpuStatsFilled++;
+    }
+}
 
+//Start sampling every CPU_STATS_PERIOD_MS from the timer task
+void cpuStatsInit(){
+    cpuStatsTimer = xTimerCreateStatic("cpuStats", pdMS_TO_TICKS(CPU_STATS_PERIOD_MS), pdTRUE, NULL, cpuStatsSample, &cpuStatsTimerBuffer);
+    xTimerStart(cpuStatsTimer, 0);
 }
 
-//Function to read and return the 1st block of the Serial Number
-//Value will be printed once at the beginning of the
-//readHDC1080Task  task
-int readSN1(){
+//Fill stats with the CPU share of each task over the sliding window
+//(or as much of it as has been sampled). Returns the number of
+//entries filled, 0 before the first full period.
+int cpuStatsGet(CpuTaskStat *stats, int maxStats){
+    uint8_t now;
+    uint8_t then;
+    uint32_t elapsed;
+    int count = 0;
+
+    vTaskSuspendAll();
+
+    now = cpuStatsSlot;
+    then = (now + CPU_STATS_WINDOW + 1 - cpuStatsFilled) % (CPU_STATS_WINDOW + 1);
+    elapsed = cpuStatsTime[now] - cpuStatsTime[then];
+
+    for(int n = 0; n < CPU_STATS_MAX_TASKS && count < maxStats && elapsed != 0; n++){
+        if(cpuStatsName[n] != NULL){
+            stats[count].name = cpuStatsName[n];
+            stats[count].permille = (uint64_t)(cpuStatsRun[now][n] - cpuStatsRun[then][n]) * 1000 / elapsed;
+            count++;
+        }
+    }
+
+    xTaskResumeAll();
 
-      uint8_t sn1[2];
-      uint8_t sn1RegVal = HDC1080SN1;
-      int ret;
+    return count;
+}
 
-      //write blocking for sn1 register
-      ret = i2c_write_blocking(I2C_PORT, HDC1080ADDRESS, &sn1RegVal, 1, false);
-      vTaskDelay(100/portTICK_PERIOD_MS);
+//print the CPU share of each task over the sliding window
+void cpuStatsPrint(){
+    CpuTaskStat stats[CPU_STATS_MAX_TASKS];
+    int count = cpuStatsGet(stats, CPU_STATS_MAX_TASKS);
 
-      //read blocking for sn1
-      ret = i2c_read_blocking(I2C_PORT, HDC1080ADDRESS, sn1, 2, false);
-      int fullSN1 = sn1[0]<<8|sn1[1];
-      
-      return fullSN1;
+    printf("task_n           cpu (last %d s)\n", CPU_STATS_WINDOW * CPU_STATS_PERIOD_MS / 1000);
+    for(int i = 0; i < count; i++){
+        printf("%-16s %3lu.%lu%%\n", stats[i].name, (unsigned long)stats[i].permille / 10, (unsigned long)stats[i].permille % 10);
+    }
 }
+//////////////////////////////CONSOLE API END//////////////////////////////////////////////////////
+
+//////////////////////////////HIGH RESOLUTION TIMER START//////////////////////////////////////////////////////
 
-//Function to read and return the 2nd block of the Serial Number
-//Value will be printed once at the beginning of the
-//readHDC1080Task  task
-int readSN2(){
+//The timer service itself is in hrtimer.c. hrSleepUs() blocks a task
+//on a one shot timer, so it lives here with the rest of the RTOS code.
 
-      uint8_t sn2[2];
-      uint8_t sn2RegVal = HDC1080SN2;
-      int ret;
+//wakes the task waiting in hrSleepUs()
+static bool hrSleepWake(void *arg){
+    BaseType_t woken = pdFALSE;
 
-      //write blocking for sn1 register
-      ret = i2c_write_blocking(I2C_PORT, HDC1080ADDRESS, &sn2RegVal, 1, false);
-      vTaskDelay(100/portTICK_PERIOD_MS);
+    vTaskNotifyGiveIndexedFromISR((TaskHandle_t)arg, HRTIMER_NOTIFY_INDEX, &woken);
+    portYIELD_FROM_ISR(woken);
 
-      //read blocking for sn1
-      ret = i2c_read_blocking(I2C_PORT, HDC1080ADDRESS, sn2, 2, false);
-      int fullSN2 = sn2[0]<<8|sn2[1];
-      
-      return fullSN2;
+    return false;
 }
 
-//Function to read and return the 3rd block of the Serial Number
-//Value will be printed once at the beginning of the
-//readHDC1080Task  task
-int readSN3(){
+//Block the calling task for us microseconds. Other tasks run (or the
+//core sleeps) in the meantime.
+void hrSleepUs(uint32_t us){
+    HrTimer timer;
+
+    if(us == 0){
+        return;
+    }
+
+    //clear a wake up left over from an earlier sleep
+    ulTaskNotifyTakeIndexed(HRTIMER_NOTIFY_INDEX, pdTRUE, 0);
 
-      uint8_t sn3[2];
-      uint8_t sn3RegVal = HDC1080SN3;
-      int ret;
+    if(!hrTimerStart(&timer, us, 0, hrSleepWake, xTaskGetCurrentTaskHandle())){
+        //no alarm free, fall back to the tick rounded up
+        vTaskDelay((us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000) + 1);
+        return;
+    }
 
-      //write blocking for sn1 register
-      ret = i2c_write_blocking(I2C_PORT, HDC1080ADDRESS, &sn3RegVal, 1, false);
-      vTaskDelay(100/portTICK_PERIOD_MS);
+    ulTaskNotifyTakeIndexed(HRTIMER_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+}
+//////////////////////////////HIGH RESOLUTION TIMER END//////////////////////////////////////////////////////
+
+//////////////////////////////I/O CORE START//////////////////////////////////////////////////////
+
+//The step engine and display scan are driven from ioCoreRun(). With
+//RT_IO_CORE set, commands are passed to core 1 through the SIO FIFO
+//and its timers run on a core 1 alarm pool, so their interrupts never
+//wait behind USB or RTOS work on core 0. Core 1 does not call FreeRTOS,
+//so the end of a move comes back to core 0 as a FIFO event.
+
+//carry out one command on the current core
+static void ioCoreRun(IoCommand cmd){
+    if(cmd == IO_CMD_STEP_START){
+        //if it cannot start, the move ends at once through the done
+        //callback, which still wakes motionMove()
+        stepEngineStart();
+    }
+    else if(cmd == IO_CMD_STEP_ENERGIZE){
+        stepEngineEnergize();
+    }
+    else if(cmd == IO_CMD_STEP_RELEASE){
+        stepEngineRelease();
+    }
+    else if(cmd == IO_CMD_SCAN_START){
+        segScanStart();
+    }
+    else if(cmd == IO_CMD_SCAN_STOP){
+        segScanStop();
+    }
+}
 
-      //read blocking for sn1
-      ret = i2c_read_blocking(I2C_PORT, HDC1080ADDRESS, sn3, 2, false);
-      int fullSN3 = sn3[0]<<8|sn3[1];
-      
-      return fullSN3;
+//Run a command on the I/O core. Shared state is written before the
+//FIFO push, which orders it for the other core.
+void ioCoreSend(IoCommand cmd){
+#if RT_IO_CORE
+    halDmb();
+    multicore_fifo_push_blocking(cmd);
+#else
+    ioCoreRun(cmd);
+#endif
 }
 
-//This function reads the current temperature from the HDC1080.
-//This function is called once every 10 seconds
-int readTemperature(){
+//tell core 0 that the running move has ended, from the step timer
+static void ioCoreStepDone(){
+#if RT_IO_CORE
+    multicore_fifo_push_blocking(IO_EVT_STEP_DONE);
+#else
+    stepEngineWake();
+#endif
+}
 
-  uint8_t temperatue[2];
-  uint8_t tempRegVal = HDC1080TEMPREG;
-  int ret;
-  int fullTemperatureC;
-  int fullTemperatureF;
+#if RT_IO_CORE
+//core 1 FIFO interrupt, runs the commands from core 0
+static void ioCoreFifoIrq1(){
+    while(multicore_fifo_rvalid()){
+        ioCoreRun(multicore_fifo_pop_blocking());
+    }
+    multicore_fifo_clear_irq();
+}
 
-    //write block for temperature
-      ret = i2c_write_blocking(I2C_PORT, HDC1080ADDRESS, &tempRegVal, 1, false);
-      vTaskDelay(100/portTICK_PERIOD_MS);
+//core 0 FIFO interrupt, handles the events from core 1
+static void ioCoreFifoIrq0(){
+    while(multicore_fifo_rvalid()){
+        if(multicore_fifo_pop_blocking() == IO_EVT_STEP_DONE){
+            stepEngineWake();
+        }
+    }
+    multicore_fifo_clear_irq();
+}
 
-      //read block for temperature
-      ret = i2c_read_blocking(I2C_PORT, HDC1080ADDRESS, temperatue, 2, false);
-      int fullTemperature = temperatue[0]<<8|temperatue[1];
+//Core 1 entry. Sets up the core 1 alarm pool and FIFO interrupt, then
+//sleeps between interrupts.
+static void ioCoreMain(){
+    halAlarmCore1Init(IO_CORE_HW_ALARM, IO_CORE_MAX_TIMERS);
 
-      float actualTempC = (fullTemperature / 65536.0) * 165 - 40;
+    irq_set_exclusive_handler(SIO_IRQ_PROC1, ioCoreFifoIrq1);
+    irq_set_enabled(SIO_IRQ_PROC1, true);
 
-      fullTemperatureC = round(actualTempC);
+    while(true){
+        __wfi();
+    }
+}
+#endif
 
-      return fullTemperatureC;
+//Start the I/O core. Called from main before anything sends it a
+//command.
+void ioCoreInit(){
+#if RT_IO_CORE
+    multicore_launch_core1(ioCoreMain);
 
+    irq_set_exclusive_handler(SIO_IRQ_PROC0, ioCoreFifoIrq0);
+    irq_set_enabled(SIO_IRQ_PROC0, true);
+#endif
+}
+//////////////////////////////I/O CORE END//////////////////////////////////////////////////////
+
+//////////////////////////////LOW POWER IDLE START//////////////////////////////////////////////////////
+
+//When every task is blocked for at least configEXPECTED_IDLE_TIME_BEFORE_SLEEP
+//ticks, FreeRTOS calls vApplicationSleep() from the idle task. The
+//SysTick is stopped and the core waits in WFI until a timer alarm set
+//for the next task deadline. Any other interrupt (button edges, the
+//step engine, the display scan, USB) wakes it early. The tick count is
+//then moved on by the time actually slept.
+
+//time spent asleep, number of sleeps and their lengths, for
+//lowPowerPrint(). A wakeup that cuts a sleep short shows as short ones.
+static volatile uint64_t lowPowerSleepUs;
+static volatile uint32_t lowPowerSleeps;
+static LatencyHist lowPowerSleepHist;
+
+#ifndef HAL_HOST
+//the wake up alarm only has to raise an interrupt
+static int64_t lowPowerAlarmCallback(alarm_id_t id, void *userData){
+    return 0;
 }
 
-//This function reads the current humidity from the HDC1080
-//This function is called once every 10 seconds
-int readHumidity(){
+void vApplicationSleep(unsigned long expectedIdle){
+    const uint32_t tickUs = 1000000 / configTICK_RATE_HZ;
+    const uint32_t tickCycles = configCPU_CLOCK_HZ / configTICK_RATE_HZ;
+    const uint32_t cyclesPerUs = configCPU_CLOCK_HZ / 1000000;
+    uint32_t irq;
+    uint32_t intoTickUs;
+    uint32_t totalUs;
+    uint32_t completeTicks;
+    uint32_t remainderUs;
+    uint64_t start;
+    uint64_t slept;
+    alarm_id_t alarm;
+
+    irq = save_and_disable_interrupts();
+
+    //a task may have been readied since the idle task decided to sleep
+    if(eTaskConfirmSleepModeStatus() == eAbortSleep){
+        restore_interrupts(irq);
+        return;
+    }
 
-      uint8_t humidty[2];
-      uint8_t humRegVal = HDC1080HUMREG;
- 
-      int ret;
-      int rndHumidity;
+    //stop the tick and note how far into the current tick we are
+    systick_hw->csr &= ~M0PLUS_SYST_CSR_ENABLE_BITS;
+    intoTickUs = (tickCycles - 1 - systick_hw->cvr) / cyclesPerUs;
+    start = halTimeUs64();
 
-      //write block for humidity
-      ret = i2c_write_blocking(I2C_PORT, HDC1080ADDRESS, &humRegVal, 1, false);
-      vTaskDelay(100/portTICK_PERIOD_MS);
+    alarm = add_alarm_in_us((uint64_t)expectedIdle * tickUs - intoTickUs, lowPowerAlarmCallback, NULL, false);
+    if(alarm > 0){
+        //WFI wakes on a pending interrupt even with interrupts masked
+        __wfi();
+        cancel_alarm(alarm);
+    }
 
-      //read block for humidity
-      ret = i2c_read_blocking(I2C_PORT, HDC1080ADDRESS, humidty, 2, false);
-      int fullHumidity = humidty[0]<<8|humidty[1];
+    slept = halTimeUs64() - start;
+    lowPowerSleepUs += slept;
+    lowPowerSleeps++;
+    histAdd(&lowPowerSleepHist, (uint32_t)slept);
+
+    //Count the whole ticks slept. If the deadline was reached, leave the
+    //last tick to a SysTick that fires right away so the kernel
+    //processes it the normal way.
+    totalUs = intoTickUs + (uint32_t)slept;
+    completeTicks = totalUs / tickUs;
+    remainderUs = tickUs - totalUs % tickUs;
+    if(completeTicks >= expectedIdle){
+        completeTicks = expectedIdle - 1;
+        remainderUs = 1;
+    }
 
-      float actualHumidity = (fullHumidity / 65536.0)*100.0;
+    //restart the tick for what is left of the current period, the
+    //reload value goes back to a full tick once it has been loaded
+    systick_hw->rvr = remainderUs * cyclesPerUs - 1;
+    systick_hw->cvr = 0;
+    systick_hw->csr |= M0PLUS_SYST_CSR_ENABLE_BITS;
 
-      rndHumidity = round(actualHumidity);      
+    vTaskStepTick(completeTicks);
 
-      return rndHumidity;
+    systick_hw->rvr = tickCycles - 1;
 
+    restore_interrupts(irq);
 }
-//////////////////////////////HDC1080 API END//////////////////////////////////////////////////////
+#else
+//The POSIX port has no tickless idle. Its tick moves the virtual clock
+//on so the alarms and the timestamps follow the RTOS time, and stands
+//in for the console interrupt.
+void vApplicationTickHook(){
+    halHostAdvanceUs(1000000 / configTICK_RATE_HZ);
+    halHostConsolePoll();
+}
+#endif
+
+//print how much of the uptime the core has spent asleep, and how long
+//the sleeps were
+void lowPowerPrint(){
+    uint64_t upUs = halTimeUs64();
+    uint64_t sleepUs = lowPowerSleepUs;
+    LatencyHist hist = lowPowerSleepHist;
+
+    printf("asleep %llu ms of %llu ms (%llu%%), %lu sleeps\n",
+           (unsigned long long)(sleepUs / 1000), (unsigned long long)(upUs / 1000),
+           (unsigned long long)(sleepUs * 100 / upUs), (unsigned long)lowPowerSleeps);
+    if(hist.total != 0){
+        printf("sleep length p50 %lu us p99 %lu us max %lu us\n",
+               (unsigned long)histPercentile(&hist, 50), (unsigned long)histPercentile(&hist, 99), (unsigned long)hist.maxUs);
+    }
+}
+//////////////////////////////LOW POWER IDLE END//////////////////////////////////////////////////////
 
-//////////////////////////////7SegLED API START//////////////////////////////////////////////////////
-//This function controls numbers displayed on the left number
-//of the 7 segment LED. segLEDLeft and segLED right share
-//the ledSem semaphore to alternate blinking sides
-//quickly so there is no flashing.
-void segLEDLeft()
-{
-    const uint LED_PIN = PICO_DEFAULT_LED_PIN;
-    // initialize digital pin LED_BUILTIN as an output.
+//////////////////////////////MEMORY MAP START//////////////////////////////////////////////////////
 
-    gpio_init(LED_PIN);
-    gpio_set_dir(LED_PIN, GPIO_OUT);
+//Every kernel object is allocated statically, so the RAM they use is
+//fixed at link time and nothing can fail to allocate at startup.
 
-    int leftNum;
+//stack and control block for the idle and timer service tasks
+static StackType_t idleTaskStack[configMINIMAL_STACK_SIZE];
+static StaticTask_t idleTaskTCB;
+static StackType_t timerTaskStack[configTIMER_TASK_STACK_DEPTH];
+static StaticTask_t timerTaskTCB;
 
-    while(true){
-        
-        //initialize counter variable
-        int i;
-
-        //peek at current value in the queue and get the left
-        //side by dividing by 10
-        if(xQueuePeek(mainControlQueue, &leftNum, 0)){
-            
-            //update value if left queue is not empty and not equal to 999
-            if(leftNum > 992){
-                leftNum = leftNum;
-           }
-           else{
-               leftNum = leftNum / 10;
-           }
-        }
+//FreeRTOS asks for the idle task memory when the scheduler starts
+void vApplicationGetIdleTaskMemory(StaticTask_t **tcb, StackType_t **stack, uint32_t *stackWords){
+    *tcb = &idleTaskTCB;
+    *stack = idleTaskStack;
+    *stackWords = configMINIMAL_STACK_SIZE;
+}
+
+//FreeRTOS asks for the timer service task memory when the scheduler starts
+void vApplicationGetTimerTaskMemory(StaticTask_t **tcb, StackType_t **stack, uint32_t *stackWords){
+    *tcb = &timerTaskTCB;
+    *stack = timerTaskStack;
+    *stackWords = configTIMER_TASK_STACK_DEPTH;
+}
 
-        //switch case for which segments to light up on the left
-        //side of the 7 segment led to display leftNum.
-        //In each case, this
-        //function will take and release the shared semaphore.
-        switch(leftNum){
-
-        //Case 0
-        case 0 :
-            for (i = 0; i < 15; i++){
-                xSemaphoreTake(ledSem, 1);
-                
-                gpio_put(SevenSegCC1, 0);   //right multiplex
-                gpio_put(SevenSegCC2, 1);   //left multiplex
-                gpio_put(SevenSegA, 1);    //top bar   
-                gpio_put(SevenSegB, 1);    //top right  
-                gpio_put(SevenSegC, 1);    //bottom right
-                gpio_put(SevenSegD, 1);    //bottom bar
-                gpio_put(SevenSegE, 1);    //bottom left
-                gpio_put(SevenSegF, 1);    //Top Left
-                gpio_put(SevenSegG, 0);    //Middle              
-                
-                xSemaphoreGive(ledSem);
-                
-                vTaskDelay(1/portTICK_PERIOD_MS);
+//RAM cost of one kernel object
+typedef struct {
+    const char *name;
+    const char *kind;
+    uint32_t bytes;
+} MemMapEntry;
+
+//The memory map, built from the same lists that allocate the objects
+#define TASK_MEM(fn, words, priority) {#fn, "task", sizeof(fn##Stack) + sizeof(fn##TCB)},
+#define QUEUE_MEM(queue, length, itemSize) {#queue, "queue", sizeof(queue##Storage) + sizeof(queue##Struct)},
+
+static const MemMapEntry memMap[] = {
+    APP_TASKS(TASK_MEM)
+    {"IDLE", "task", sizeof(idleTaskStack) + sizeof(idleTaskTCB)},
+    {"Tmr Svc", "task", sizeof(timerTaskStack) + sizeof(timerTaskTCB)},
+    APP_QUEUES(QUEUE_MEM)
+    {"cpuStats", "timer", sizeof(cpuStatsTimerBuffer)},
+};
+
+//print the RAM used by each kernel object and the total
+void memoryReport(){
+    uint32_t total = 0;
+
+    printf("object           kind   bytes\n");
+    for(unsigned i = 0; i < sizeof(memMap) / sizeof(memMap[0]); i++){
+        printf("%-16s %-6s %5lu\n", memMap[i].name, memMap[i].kind, (unsigned long)memMap[i].bytes);
+        total += memMap[i].bytes;
+    }
+    printf("total                   %5lu\n", (unsigned long)total);
+}
+//////////////////////////////MEMORY MAP END//////////////////////////////////////////////////////
+
+//////////////////////////////STACK MONITOR START//////////////////////////////////////////////////////
+
+//The fewest free stack words seen for each task, sampled with the CPU
+//usage every CPU_STATS_PERIOD_MS and indexed by task number. FreeRTOS
+//fills the stacks with a known pattern, so the high water mark is the
+//deepest the task has ever reached, not just at the sample.
+static uint16_t stackMinFree[CPU_STATS_MAX_TASKS];
+static const char *stackName[CPU_STATS_MAX_TASKS];
+
+//stack depth in words each task was created with, after
+//APP_STACK_WORDS() has sized it for the build
+typedef struct {
+    const char *name;
+    uint16_t words;
+} StackBudget;
+
+#define TASK_STACK(fn, words, priority) {#fn, APP_STACK_WORDS(words)},
+
+static const StackBudget stackBudget[] = {
+    APP_TASKS(TASK_STACK)
+    {"IDLE", configMINIMAL_STACK_SIZE},
+    {"Tmr Svc", configTIMER_TASK_STACK_DEPTH},
+};
+
+//Called from the cpuStats timer with the task states it just read
+void stackSample(const TaskStatus_t *tasks, UBaseType_t count){
+    for(UBaseType_t i = 0; i < count; i++){
+        UBaseType_t n = tasks[i].xTaskNumber;
+
+        if(n < CPU_STATS_MAX_TASKS){
+            if(stackName[n] == NULL || tasks[i].usStackHighWaterMark < stackMinFree[n]){
+                stackMinFree[n] = tasks[i].usStackHighWaterMark;
             }
-            break;
-
-        //case 1
-        case 1 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle             
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 2
-        case 2 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                            
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 3
-        case 3 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle               
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 4
-        case 4 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle              
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 5
-        case 5 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                 
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 6
-        case 6 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 7
-        case 7 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle               
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 8
-        case 8 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
+            stackName[n] = tasks[i].pcTaskName;
         }
-        break;
-
-        //case 9
-        case 9 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //overflow OF
-        case 993:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //move on Temp -- PP
-        case 994:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //move on humidity -- HH
-        case 995:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //full cw -- FF
-        case 996:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //constant ccw - bb
-        case 997:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //full rotation back and forth
-        case 998:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //display E
-        case 999:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 0);   //right multiplex
-            gpio_put(SevenSegCC2, 1);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
+    }
+}
+
+//smallest stack in words that still leaves the safety margin over the
+//deepest use seen
+static uint32_t stackSuggest(uint32_t used){
+    uint32_t spare = used * STACK_MARGIN_PCT / 100;
+
+    if(spare < STACK_MIN_SPARE){
+        spare = STACK_MIN_SPARE;
+    }
+    return (used + spare + STACK_ROUND - 1) / STACK_ROUND * STACK_ROUND;
+}
+
+//print the size, deepest use and suggested size of every task stack in
+//words. Tasks that have not been sampled yet are left out.
+void stackReport(){
+    uint16_t minFree[CPU_STATS_MAX_TASKS];
+    const char *name[CPU_STATS_MAX_TASKS];
+
+    vTaskSuspendAll();
+    memcpy(minFree, stackMinFree, sizeof(minFree));
+    memcpy(name, stackName, sizeof(name));
+    xTaskResumeAll();
+
+    printf("task_n           size  used  suggest (words)\n");
+    for(int n = 0; n < CPU_STATS_MAX_TASKS; n++){
+        if(name[n] == NULL){
+            continue;
+        }
+        for(unsigned i = 0; i < sizeof(stackBudget) / sizeof(stackBudget[0]); i++){
+            if(strcmp(stackBudget[i].name, name[n]) == 0){
+                //more free than the budget means the budget is not the
+                //size the task has, count it as unused rather than wrap
+                uint32_t used = minFree[n] < stackBudget[i].words ? stackBudget[i].words - minFree[n] : 0;
+
+                printf("%-16s %4u  %4lu  %4lu\n", name[n], stackBudget[i].words, (unsigned long)used, (unsigned long)stackSuggest(used));
+            }
         }
-        break;
+    }
+}
+
+//FreeRTOS calls this on a context switch when a task has run past the
+//end of its stack. The task's memory can no longer be trusted, so
+//report which task it was and halt.
+void vApplicationStackOverflowHook(TaskHandle_t task, char *name){
+    halPanic("stack overflow in %s\n", name);
+}
+//////////////////////////////STACK MONITOR END//////////////////////////////////////////////////////
+
+//////////////////////////////TRACE RECORDER START//////////////////////////////////////////////////////
+
+//The FreeRTOS trace hooks in FreeRTOSConfig.h record task switches,
+//queue and semaphore traffic and task notifications here, with the
+//1 MHz timer as the clock. The ring always holds the last TRACE_LEN
+//events. It is dumped on the console as a binary trace frame, see
+//task_stream.h, which tools/tracedump turns into Chrome trace JSON for
+//chrome://tracing or ui.perfetto.dev.
+
+#if TRACE_LEN > TASK_TRACE_MAX_EVENTS
+#error "TRACE_LEN must fit in one trace frame"
+#endif
+
+static TraceEvent traceRing[TRACE_LEN];
+static uint32_t traceHead;              //events written since boot
+static uint8_t traceTask;               //task number switched in last
+static volatile bool tracePaused;       //set while the ring is dumped
+
+//queue names by trace number
+#define QUEUE_TRACE_NAME(queue, length, itemSize) #queue,
+static const char *const traceQueueName[] = {"kernel queue", APP_QUEUES(QUEUE_TRACE_NAME)};
+
+//number of queue names, the kernel one included
+#define QUEUE_TRACE_COUNT(queue, length, itemSize) + 1
+#define TRACE_QUEUES (1 APP_QUEUES(QUEUE_TRACE_COUNT))
+
+#if CPU_STATS_MAX_TASKS + TRACE_QUEUES > TASK_TRACE_MAX_NAMES
+#error "every task and queue name must fit in one trace frame"
+#endif
+
+//Called by the kernel hooks from tasks, interrupts and the context
+//switch. Runs from RAM with interrupts briefly off, so an event costs a
+//timer read and four stores rather than a flash cache miss.
+void HAL_RAM_FUNC(traceRecord)(unsigned int event, unsigned int object){
+    uint32_t irq;
+    TraceEvent *entry;
+
+    if(tracePaused){
+        return;
+    }
+
+    irq = halIrqSave();
+    if(event == TRACE_SWITCH_IN){
+        traceTask = object;
+    }
+    entry = &traceRing[traceHead++ & (TRACE_LEN - 1)];
+    entry->timeUs = halTimeUs32();
+    entry->event = event;
+    entry->task = traceTask;
+    entry->object = object;
+    halIrqRestore(irq);
+}
+
+//write frame bytes to the console unchanged
+static void traceConsolePut(const uint8_t *data, size_t len){
+    for(size_t i = 0; i < len; i++){
+        halConsolePutRaw(data[i]);
+    }
+}
+
+//Write the ring to the console as one trace frame, oldest event first,
+//with the names of the tasks seen by the CPU usage sampler and of the
+//queues. The events go out straight from the ring, 8 bytes each.
+//Recording pauses while it is written so the dump is consistent.
+void traceDump(){
+    static TraceName names[CPU_STATS_MAX_TASKS + TRACE_QUEUES];
+    uint8_t nameCount = 0;
+    uint32_t head;
+    uint32_t count;
+    uint32_t first;
+    uint32_t firstCount;
+
+    tracePaused = true;
+    head = traceHead;
+    count = head < TRACE_LEN ? head : TRACE_LEN;
+    first = (head - count) & (TRACE_LEN - 1);
+    firstCount = count < TRACE_LEN - first ? count : TRACE_LEN - first;
+
+    for(unsigned n = 0; n < CPU_STATS_MAX_TASKS; n++){
+        if(cpuStatsName[n] != NULL){
+            names[nameCount].kind = TRACE_NAME_TASK;
+            names[nameCount].number = n;
+            strncpy(names[nameCount].name, cpuStatsName[n], sizeof(names[nameCount].name));
+            nameCount++;
         }
     }
+    for(unsigned n = 0; n < TRACE_QUEUES; n++){
+        names[nameCount].kind = TRACE_NAME_QUEUE;
+        names[nameCount].number = n;
+        strncpy(names[nameCount].name, traceQueueName[n], sizeof(names[nameCount].name));
+        nameCount++;
+    }
+
+    taskTraceWrite(traceConsolePut, names, nameCount, &traceRing[first], firstCount,
+                   traceRing, count - firstCount);
+    halConsoleFlush();
+
+    tracePaused = false;
 }
+//////////////////////////////TRACE RECORDER END//////////////////////////////////////////////////////
 
-//This function controls numbers displayed on the right number
-//of the 7 segment LED. segLEDLeft and segLED right share
-//the ledSem semaphore to alternate blinking sides
-//quickly so there is no flashing.
-void segLEDRight()
-{
-    const uint LED_PIN = PICO_DEFAULT_LED_PIN;
-    // initialize digital pin LED_BUILTIN as an output.
+//////////////////////////////LATENCY HISTOGRAMS START//////////////////////////////////////////////////////
 
-    gpio_init(LED_PIN);
-    gpio_set_dir(LED_PIN, GPIO_OUT);
+//Every reading carries the halTimeUs64() it was taken at through the
+//snapshot, so each stage only has to record now minus that stamp.
+//Each histogram has a single writer: the display stage is recorded by
+//the scan interrupt on the I/O core, the others by tasks on core 0.
+static LatencyHist latHist[LAT_STAGES];
 
-    int rightNum;
+static const char *const latStageName[LAT_STAGES] = {
+    [LAT_HANDOFF] = "handoff",
+    [LAT_DISPLAY] = "display",
+    [LAT_MOTOR] = "motor",
+};
 
-    while(true){
+//Record the time since sourceUs for stage
+void latencyRecord(LatencyStage stage, uint64_t sourceUs){
+    uint64_t elapsed = halTimeUs64() - sourceUs;
 
-        //initialize variables for counter
-        int i;
-        
-        //peek at number in the queue and get the right digit by
-        //perfoming a mod on the number in the queue
-        if(xQueuePeek(mainControlQueue, &rightNum, 0)){
-            
-            //if queue number isn't 999, continue
-            //else it's the Emergency stop code.
-            if(rightNum > 992){
-                rightNum = rightNum;
-            }
-            else{
-                //update rightNum if queue is not empty
-                rightNum = rightNum % 10;
-            }
-        }
-        
-        //Switch case to determine which segments of the right digit
-        //on the 7 segment led to light up based on rightNum. 
-        //In each case, this
-        //function will take and release the shared semaphore.
-        switch(rightNum){
-        //Case 0
-        case 0 :
-        for (i = 0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle              
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 1
-        case 1 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle              
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 2
-        case 2 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle             
-            
-            xSemaphoreGive(ledSem);
-           
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 3
-        case 3 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle  
-                               
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 4
-        case 4 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle  
-                          
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 5
-        case 5 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-            
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                 
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 6
-        case 6 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-            
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 7
-        case 7 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 0);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle               
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 8
-        case 8 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //case 9
-        case 9 :
-        for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 0);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //overflow OF
-        case 993:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //mvoe on Temp -- PP
-        case 994:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //move on humidity -- HH
-        case 995:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 1);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //full cw -- FF
-        case 996:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 0);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //constant ccw - bb
-        case 997:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 0);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 1);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //full rotation back and forth - CC
-        case 998:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 0);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-
-        //Emergncy Stop Display
-        case 999:
-            for(i=0; i < 15; i++){
-            xSemaphoreTake(ledSem, 1);
-
-            gpio_put(SevenSegCC1, 1);   //right multiplex
-            gpio_put(SevenSegCC2, 0);   //left multiplex
-            gpio_put(SevenSegA, 1);    //top bar   
-            gpio_put(SevenSegB, 0);    //top right  
-            gpio_put(SevenSegC, 0);    //bottom right
-            gpio_put(SevenSegD, 1);    //bottom bar
-            gpio_put(SevenSegE, 1);    //bottom left
-            gpio_put(SevenSegF, 1);    //Top Left
-            gpio_put(SevenSegG, 1);    //Middle                
-            
-            xSemaphoreGive(ledSem);
-
-            vTaskDelay(1/portTICK_PERIOD_MS);
-        }
-        break;
-        }
+    histAdd(&latHist[stage], elapsed > UINT32_MAX ? UINT32_MAX : elapsed);
+}
+
+//print the count, p50, p99 and max latency of each stage. Percentiles
+//are bucket upper bounds, so they round up to the next power of two.
+void latencyPrint(){
+    LatencyHist hist;
+
+    printf("stage       count      p50 us     p99 us     max us\n");
+    for(int stage = 0; stage < LAT_STAGES; stage++){
+        hist = latHist[stage];
+        printf("%-10s %6lu %10lu %10lu %10lu\n", latStageName[stage], (unsigned long)hist.total,
+               (unsigned long)histPercentile(&hist, 50), (unsigned long)histPercentile(&hist, 99), (unsigned long)hist.maxUs);
     }
 }
-//////////////////////////////7SegLED API END//////////////////////////////////////////////////////
+//////////////////////////////LATENCY HISTOGRAMS END//////////////////////////////////////////////////////
+
+//////////////////////////////STEP TIMING START//////////////////////////////////////////////////////
+
+//The step engine times every step, see step_engine.c. This prints
+//what it recorded.
+
+//print the last move and the jitter since boot
+void stepTimingPrint(){
+    StepMoveStats move;
+    LatencyHist hist;
+    uint32_t late;
+
+    if(stepTimingLastMove(&move) && move.steps != 0){
+        printf("last move: %lu steps, %lu late, error %ld to %ld us, mean |error| %lu us\n",
+               (unsigned long)move.steps, (unsigned long)move.late, (long)move.minErrUs, (long)move.maxErrUs, (unsigned long)move.meanAbsErrUs);
+    }
+
+    stepTimingJitter(&hist, &late);
+    printf("all steps: %lu, %lu late (>%d%%), |error| p50 %lu us p99 %lu us max %lu us\n",
+           (unsigned long)hist.total, (unsigned long)late, STEP_LATE_PCT,
+           (unsigned long)histPercentile(&hist, 50), (unsigned long)histPercentile(&hist, 99), (unsigned long)hist.maxUs);
+}
+//////////////////////////////STEP TIMING END//////////////////////////////////////////////////////
+
+//////////////////////////////SENSOR SNAPSHOT START//////////////////////////////////////////////////////
+
+//The latest reading and motor status are kept in one struct guarded by
+//a sequence counter. A writer makes the counter odd, updates the
+//struct and makes it even again. A reader copies the struct and
+//retries if the counter was odd or changed under it, so readers never
+//block and never see a half updated snapshot. Writers are kept apart
+//with a critical section, which is only held for the copy.
+static SensorSnapshot snapData;
+static volatile uint32_t snapSeq;
+
+//start a write, called inside the critical section
+static inline void snapshotWriteBegin(){
+    snapSeq++;
+    halDmb();
+}
+
+//finish a write, called inside the critical section
+static inline void snapshotWriteEnd(){
+    halDmb();
+    snapSeq++;
+}
+
+//Publish a new sensor reading taken at timestampUs
+void snapshotPublishReading(const HDC1080Reading *reading, uint64_t timestampUs){
+    taskENTER_CRITICAL();
+    snapshotWriteBegin();
+    snapData.reading = *reading;
+    snapData.timestampUs = timestampUs;
+    snapshotWriteEnd();
+    taskEXIT_CRITICAL();
+}
+
+//Publish a new motor status
+void snapshotSetMotorStatus(int status){
+    taskENTER_CRITICAL();
+    snapshotWriteBegin();
+    snapData.motorStatus = status;
+    snapshotWriteEnd();
+    taskEXIT_CRITICAL();
+}
+
+//Copy out a consistent snapshot without locking
+void snapshotRead(SensorSnapshot *snap){
+    uint32_t seq;
 
+    do{
+        seq = snapSeq;
+        halDmb();
+        *snap = snapData;
+        halDmb();
+    } while((seq & 1) || seq != snapSeq);
+}
+//////////////////////////////SENSOR SNAPSHOT END//////////////////////////////////////////////////////
+
+//////////////////////////////7SegLED API START//////////////////////////////////////////////////////
+
+//The glyph tables, frames and scan timer are in seg_display.c. These
+//calls are the task side: they keep the writers apart and record the
+//latency of each reading shown.
+
+//the scan interrupt lit a new reading taken at sourceUs
+static void segDisplayShown(uint64_t sourceUs){
+    latencyRecord(LAT_DISPLAY, sourceUs);
+}
+
+//Swap in a new frame. Writers are kept apart by suspending the
+//scheduler, which leaves the scan interrupt running.
+static void segDisplayFrame(uint8_t left, uint8_t right, uint64_t sourceUs){
+    vTaskSuspendAll();
+    segFrameShow(left, right, sourceUs);
+    xTaskResumeAll();
+}
+
+//Show a pair of glyphs
+void segDisplayGlyphs(uint8_t left, uint8_t right){
+    segDisplayFrame(left, right, 0);
+}
+
+//Show a value (0-99 or one of the 992-999 status codes)
+void segDisplayValue(int value){
+    segDisplayFrame(segLeftGlyph(value), segRightGlyph(value), 0);
+}
 
+//Show a value from the sensor reading taken at sourceUs. The first time
+//a reading is shown its hand off and display latency are recorded,
+//showing it again is not counted.
+void segDisplayReading(int value, uint64_t sourceUs){
+    static uint64_t lastUs;
 
+    if(sourceUs == lastUs){
+        sourceUs = 0;
+    }
+    else{
+        lastUs = sourceUs;
+        latencyRecord(LAT_HANDOFF, sourceUs);
+    }
+    segDisplayFrame(segLeftGlyph(value), segRightGlyph(value), sourceUs);
+}
+
+//Blank the display and stop the scan interrupt, or start it again.
+//Blanking lets the core sleep through idle periods without waking at
+//SEG_SCAN_HZ.
+void segDisplaySetEnabled(bool enabled){
+    static bool scanning = true;
+
+    if(enabled && !scanning){
+        ioCoreSend(IO_CMD_SCAN_START);
+    }
+    else if(!enabled && scanning){
+        ioCoreSend(IO_CMD_SCAN_STOP);
+    }
+    scanning = enabled;
+}
+
+//Set up the initial frame and start the scan timer. Called from main
+//after ioCoreInit() and before the scheduler starts.
+void segDisplayInit(){
+    segFramesInit(segDisplayShown);
+
+    ioCoreSend(IO_CMD_SCAN_START);
+}
+//////////////////////////////7SegLED API END//////////////////////////////////////////////////////
@@ -1,18 +1,33 @@
 #ifndef FREERTOS_CONFIG_H
 #define FREERTOS_CONFIG_H
 
+/* HAL_HOST builds the tasks against the FreeRTOS POSIX port, see hal.h.
+Only the port specific settings below differ. */
+
+#ifndef HAL_HOST
 /* Use Pico SDK ISR handlers */
 #define vPortSVCHandler         isr_svcall
 #define xPortPendSVHandler      isr_pendsv
 #define xPortSysTickHandler     isr_systick
+#endif
 
 #define configUSE_PREEMPTION                    1
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+#ifndef HAL_HOST
+#define configUSE_TICKLESS_IDLE                 2
+#else
 #define configUSE_TICKLESS_IDLE                 0
+#endif
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP   2
 #define configCPU_CLOCK_HZ                      133000000
 #define configTICK_RATE_HZ                      100
 #define configMAX_PRIORITIES                    5
+#ifndef HAL_HOST
 #define configMINIMAL_STACK_SIZE                128
+#else
+/* POSIX port tasks are host threads and need host sized stacks */
+#define configMINIMAL_STACK_SIZE                4096
+#endif
 #define configMAX_TASK_NAME_LEN                 16
 #define configUSE_16_BIT_TICKS                  0
 #define configIDLE_SHOULD_YIELD                 1
@@ -31,21 +46,25 @@
 #define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
 
 /* Memory allocation related definitions. */
-#define configSUPPORT_STATIC_ALLOCATION         0
-#define configSUPPORT_DYNAMIC_ALLOCATION        1
-#define configAPPLICATION_ALLOCATED_HEAP        1
+#define configSUPPORT_STATIC_ALLOCATION         1
+#define configSUPPORT_DYNAMIC_ALLOCATION        0
 
 /* Hook function related definitions. */
 #define configUSE_IDLE_HOOK                     0
+#ifndef HAL_HOST
 #define configUSE_TICK_HOOK                     0
-#define configCHECK_FOR_STACK_OVERFLOW          0
+#else
+/* the tick hook moves the host virtual clock, see Assign9.c */
+#define configUSE_TICK_HOOK                     1
+#endif
+#define configCHECK_FOR_STACK_OVERFLOW          2
 #define configUSE_MALLOC_FAILED_HOOK            0
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
+#define configGENERATE_RUN_TIME_STATS           1
 #define configUSE_TRACE_FACILITY                1
-#define configUSE_STATS_FORMATTING_FUNCTIONS    1
+#define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
 /* Co-routine related definitions. */
 #define configUSE_CO_ROUTINES                   0
@@ -70,7 +89,7 @@
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_xTaskGetSchedulerState          1
 #define INCLUDE_xTaskGetCurrentTaskHandle       1
-#define INCLUDE_uxTaskGetStackHighWaterMark     0
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
 #define INCLUDE_xTaskGetIdleTaskHandle          0
 #define INCLUDE_eTaskGetState                   0
 #define INCLUDE_xEventGroupSetBitFromISR        1
@@ -79,6 +98,49 @@
 #define INCLUDE_xTaskGetHandle                  0
 #define INCLUDE_xTaskResumeFromISR              1
 
+/* Run time stats count microseconds on the RP2040 1 MHz timer, which the
+SDK starts at boot, so no extra timer setup is needed. */
+#ifndef __ASSEMBLER__
+extern unsigned long runTimeCounter( void );
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        runTimeCounter()
+
+/* Tickless idle sleeps on an RP2040 timer alarm instead of the SysTick,
+see vApplicationSleep() in Assign9.c. */
+#ifndef HAL_HOST
+#ifndef __ASSEMBLER__
+extern void vApplicationSleep( unsigned long xExpectedIdleTime );
+#endif
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime ) vApplicationSleep( xExpectedIdleTime )
+#endif
+
 /* A header file that defines trace macro can be included here. */
 
+/* Trace recorder, the kernel hooks store timestamped events in a RAM
+ring in Assign9.c. Queue hooks also cover semaphores, which are queues.
+Each hook runs inside the kernel file that expands it, so it can read
+the task and queue numbers straight from the TCB or queue. */
+#define TRACE_SWITCH_IN                         0
+#define TRACE_SWITCH_OUT                        1
+#define TRACE_QUEUE_SEND                        2
+#define TRACE_QUEUE_RECEIVE                     3
+#define TRACE_NOTIFY                            4
+#define TRACE_NOTIFY_WAIT                       5
+
+#ifndef __ASSEMBLER__
+extern void traceRecord( unsigned int event, unsigned int object );
+#endif
+#define traceTASK_SWITCHED_IN()                 traceRecord( TRACE_SWITCH_IN, pxCurrentTCB->uxTCBNumber )
+#define traceTASK_SWITCHED_OUT()                traceRecord( TRACE_SWITCH_OUT, pxCurrentTCB->uxTCBNumber )
+#define traceQUEUE_SEND( pxQueue )              traceRecord( TRACE_QUEUE_SEND, ( pxQueue )->uxQueueNumber )
+#define traceQUEUE_SEND_FROM_ISR( pxQueue )     traceRecord( TRACE_QUEUE_SEND, ( pxQueue )->uxQueueNumber )
+#define traceQUEUE_RECEIVE( pxQueue )           traceRecord( TRACE_QUEUE_RECEIVE, ( pxQueue )->uxQueueNumber )
+#define traceQUEUE_RECEIVE_FROM_ISR( pxQueue )  traceRecord( TRACE_QUEUE_RECEIVE, ( pxQueue )->uxQueueNumber )
+#define traceTASK_NOTIFY( uxIndexToNotify )             traceRecord( TRACE_NOTIFY, pxTCB->uxTCBNumber )
+#define traceTASK_NOTIFY_FROM_ISR( uxIndexToNotify )    traceRecord( TRACE_NOTIFY, pxTCB->uxTCBNumber )
+#define traceTASK_NOTIFY_GIVE_FROM_ISR( uxIndexToNotify ) traceRecord( TRACE_NOTIFY, pxTCB->uxTCBNumber )
+#define traceTASK_NOTIFY_TAKE( uxIndexToWait )          traceRecord( TRACE_NOTIFY_WAIT, uxIndexToWait )
+#define traceTASK_NOTIFY_WAIT( uxIndexToWait )          traceRecord( TRACE_NOTIFY_WAIT, uxIndexToWait )
+
 #endif /* FREERTOS_CONFIG_H */
\ No newline at end of file
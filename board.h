@@ -0,0 +1,32 @@
+//Pin assignments of the Vandaluino3 PCB, shared by the task code and
+//the modules that drive the pins
+
+#ifndef BOARD_H
+#define BOARD_H
+
+//Step Motor Pins and steps
+//IN1=12,  IN2=9, IN3=8,IN4=19
+#define StepMotorIN1 12
+#define StepMotorIN2 1
+#define StepMotorIN3 0
+#define StepMotorIN4 6
+
+//Button pines
+#define ButtonS1 19
+#define ButtonS2 9
+#define ButtonS3 8
+
+//define 7-segment led pins
+#define SevenSegCC1 11  //right number
+#define SevenSegCC2 10  //left number
+
+#define SevenSegA 26    //Top bar
+#define SevenSegB 27    //Top right
+#define SevenSegC 29    //bottom right
+#define SevenSegD 18    //bottom bar
+#define SevenSegE 25    //bottom left
+#define SevenSegF 7     //Top Left
+#define SevenSegG 28    //Middle
+#define SevenSegDP 24   //decimal points
+
+#endif
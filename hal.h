@@ -0,0 +1,268 @@
+//Hardware layer for the task code in Assign9.c. Everything the tasks
+//do to pins, the I2C bus, the clock, the alarms and the console goes
+//through these calls.
+//
+//On the Pico they are inline wrappers around the SDK, so they cost the
+//same as calling it directly, plus a few helpers in hal_pico.c. Building
+//with HAL_HOST defined selects the fake backend in hal_host.c instead,
+//which keeps pin levels and a virtual clock in memory, logs every pin
+//write with its virtual time, fires alarms as the clock moves and hands
+//I2C transfers to devices attached by address.
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//returned by halI2cWrite()/halI2cRead() when nothing answers, the same
+//value as the SDK's PICO_ERROR_GENERIC
+#define HAL_I2C_ERROR (-2)
+
+//returned when the bus does not come free, the same value as the
+//SDK's PICO_ERROR_TIMEOUT
+#define HAL_I2C_TIMEOUT (-1)
+
+//returned by halConsoleGetChar() when no character is waiting
+#define HAL_CONSOLE_NONE (-1)
+
+//Alarm callback, runs in interrupt context. Returns 0 to stop, or -us
+//to run again us after the time this call was due (the SDK convention).
+typedef int64_t (*HalAlarmCallback)(int32_t id, void *arg);
+
+//called from the GPIO interrupt on both edges of an input pin
+typedef void (*HalGpioIrqCallback)(unsigned gpio);
+
+//called from interrupt context when console characters may be waiting
+typedef void (*HalConsoleRxCallback)(void *arg);
+
+#ifndef HAL_HOST
+
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+#include "tusb.h"
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+
+//I2C bus the sensor is on
+#define HAL_I2C_PORT i2c1
+
+//functions that must run from RAM, such as ones called by kernel hooks
+#define HAL_RAM_FUNC(name) __not_in_flash_func(name)
+
+//report a fatal error and halt
+#define halPanic panic
+
+//A pending alarm, id 0 when none. The pool is the one of the core that
+//started it, cancelling goes back to the same pool.
+typedef struct {
+    alarm_pool_t *pool;
+    alarm_id_t id;
+} HalAlarm;
+
+//microseconds since boot, low 32 bits
+static inline uint32_t halTimeUs32(){
+    return time_us_32();
+}
+
+//microseconds since boot
+static inline uint64_t halTimeUs64(){
+    return time_us_64();
+}
+
+//Mask interrupts on this core, returns the state to restore
+static inline uint32_t halIrqSave(){
+    return save_and_disable_interrupts();
+}
+
+static inline void halIrqRestore(uint32_t state){
+    restore_interrupts(state);
+}
+
+//order memory accesses, for data shared with interrupts or the other core
+static inline void halDmb(){
+    __dmb();
+}
+
+//set up one pin as a plain input or output
+static inline void halGpioInit(unsigned gpio, bool out){
+    gpio_init(gpio);
+    gpio_set_dir(gpio, out ? GPIO_OUT : GPIO_IN);
+}
+
+//set the pins in mask to the matching bits of value in one write
+static inline void halGpioPutMasked(uint32_t mask, uint32_t value){
+    gpio_put_masked(mask, value);
+}
+
+//level of one pin
+static inline bool halGpioGet(unsigned gpio){
+    return gpio_get(gpio);
+}
+
+//call callback on both edges of gpio, from the GPIO interrupt
+void halGpioIrqEnable(unsigned gpio, HalGpioIrqCallback callback);
+
+//Start the sensor bus at baud on the default I2C pins, with pull-ups
+static inline void halI2cInit(uint32_t baud){
+    i2c_init(HAL_I2C_PORT, baud);
+    gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(PICO_DEFAULT_I2C_SDA_PIN);
+    gpio_pull_up(PICO_DEFAULT_I2C_SCL_PIN);
+
+    // Make the I2C pins available to picotool
+    bi_decl(bi_2pins_with_func(PICO_DEFAULT_I2C_SDA_PIN, PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C));
+}
+
+//Write len bytes to the device at addr. nostop keeps the bus for a
+//following transfer. Returns the bytes written or a negative error.
+static inline int halI2cWrite(uint8_t addr, const uint8_t *src, size_t len, bool nostop){
+    return i2c_write_blocking(HAL_I2C_PORT, addr, src, len, nostop);
+}
+
+//Read len bytes from the device at addr. Returns the bytes read or a
+//negative error.
+static inline int halI2cRead(uint8_t addr, uint8_t *dst, size_t len, bool nostop){
+    return i2c_read_blocking(HAL_I2C_PORT, addr, dst, len, nostop);
+}
+
+//Run callback from the alarm interrupt of this core after delayUs. The
+//id is stored in alarm unless the callback already ran and finished.
+//Returns false if no alarm slot is free.
+bool halAlarmStart(HalAlarm *alarm, uint32_t delayUs, HalAlarmCallback callback, void *arg);
+
+//cancel the alarm if it is still pending
+void halAlarmCancel(HalAlarm *alarm);
+
+//Give core 1 its own alarm pool on hardware alarm hwAlarm, so alarms
+//started there interrupt core 1. Called on core 1.
+void halAlarmCore1Init(unsigned hwAlarm, unsigned maxAlarms);
+
+//Start USB stdio and wait for the host to open the port
+static inline void halConsoleInit(){
+    stdio_init_all();
+    while (!tud_cdc_connected()) { sleep_ms(100);  }
+}
+
+//next console character, or HAL_CONSOLE_NONE without waiting
+static inline int halConsoleGetChar(){
+    int c = getchar_timeout_us(0);
+
+    return c < 0 ? HAL_CONSOLE_NONE : c;
+}
+
+//Call callback when characters arrive on the console, NULL stops it.
+//USB stdio calls it from its low priority interrupt on core 0.
+static inline void halConsoleSetRxCallback(HalConsoleRxCallback callback, void *arg){
+    stdio_set_chars_available_callback(callback, arg);
+}
+
+//write one byte to the console without CR/LF translation
+static inline void halConsolePutRaw(uint8_t c){
+    putchar_raw(c);
+}
+
+static inline void halConsoleFlush(){
+    stdio_flush();
+}
+
+#else
+
+#define HAL_RAM_FUNC(name) name
+
+typedef struct {
+    int32_t id;
+} HalAlarm;
+
+uint32_t halTimeUs32();
+uint64_t halTimeUs64();
+uint32_t halIrqSave();
+void halIrqRestore(uint32_t state);
+void halDmb();
+void halGpioInit(unsigned gpio, bool out);
+void halGpioPutMasked(uint32_t mask, uint32_t value);
+bool halGpioGet(unsigned gpio);
+void halGpioIrqEnable(unsigned gpio, HalGpioIrqCallback callback);
+void halI2cInit(uint32_t baud);
+int halI2cWrite(uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int halI2cRead(uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+bool halAlarmStart(HalAlarm *alarm, uint32_t delayUs, HalAlarmCallback callback, void *arg);
+void halAlarmCancel(HalAlarm *alarm);
+void halConsoleInit();
+int halConsoleGetChar();
+void halConsoleSetRxCallback(HalConsoleRxCallback callback, void *arg);
+void halConsolePutRaw(uint8_t c);
+void halConsoleFlush();
+void halPanic(const char *fmt, ...);
+
+//One logged pin write: the pins in mask were set to value at timeUs
+typedef struct {
+    uint64_t timeUs;
+    uint32_t mask;
+    uint32_t value;
+} HalPinWrite;
+
+//A fake I2C device. write and read get the bytes of one transfer and
+//return the number handled or a negative error, ctx is passed back.
+typedef struct {
+    int (*write)(void *ctx, const uint8_t *src, size_t len);
+    int (*read)(void *ctx, uint8_t *dst, size_t len);
+    void *ctx;
+} HalI2cDevice;
+
+//Called after every pin write with the write, so models of what is on
+//the pins can follow them
+typedef void (*HalPinWatcher)(void *ctx, const HalPinWrite *write);
+
+//Microseconds an alarm due at dueUs runs late, for modelling masked
+//interrupts or a busy core
+typedef uint32_t (*HalAlarmLatency)(void *ctx, uint64_t dueUs);
+
+//Move the virtual clock forward, running every alarm that falls due on
+//the way at the time it was due
+void halHostAdvanceUs(uint64_t us);
+
+//Drive an input pin from outside, as a button or sensor would. A
+//change of level runs the pin's interrupt callback.
+void halHostSetInput(unsigned gpio, bool level);
+
+//current level of every pin, one bit per pin
+uint32_t halHostPins();
+
+//copy the newest max logged pin writes, oldest first, returns the
+//number copied
+size_t halHostPinLog(HalPinWrite *writes, size_t max);
+
+//forget every logged pin write
+void halHostPinLogClear();
+
+//answer I2C transfers to addr with dev, NULL detaches
+void halHostI2cAttach(uint8_t addr, const HalI2cDevice *dev);
+
+//call watcher after every pin write. Returns false if every watcher
+//slot is already taken.
+bool halHostWatchPins(HalPinWatcher watcher, void *ctx);
+
+//stop calling a watcher registered with the same watcher and ctx
+void halHostUnwatchPins(HalPinWatcher watcher, void *ctx);
+
+//alarms waiting to run
+int halHostAlarmsPending();
+
+//Run the console callback if stdin has input waiting. Nothing raises
+//an interrupt for stdin, so whatever drives the host build calls this,
+//once a tick in Assign9_host.
+void halHostConsolePoll();
+
+//Run every alarm scheduled from now on latency() late. Periodic
+//alarms are still rescheduled relative to when they were due. NULL
+//runs them on time again.
+void halHostSetAlarmLatency(HalAlarmLatency latency, void *ctx);
+
+#endif
+
+#endif
@@ -0,0 +1,372 @@
+//Fake hardware backend for building the task code on a host, selected
+//with HAL_HOST. Nothing here touches real hardware: the clock only
+//moves when halHostAdvanceUs() is called, alarms run as it passes
+//their due time, pin levels live in one word, and I2C transfers go to
+//whatever device is attached at the address. Every pin write is logged
+//with the virtual time it happened at, so a run can be checked or
+//timed after the fact. The console is stdin and stdout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "hal.h"
+
+//pin writes kept in the log, the newest are kept. Must be a power of two.
+#define HAL_HOST_PIN_LOG 4096
+
+//7-bit I2C addresses
+#define HAL_HOST_I2C_ADDRS 128
+
+//pin watchers that can be registered
+#define HAL_HOST_WATCHERS 4
+
+//alarms that can be pending at once, like the slots of an alarm pool
+#define HAL_HOST_ALARMS 8
+
+//pins with an interrupt callback
+#define HAL_HOST_GPIOS 32
+
+typedef struct {
+    int32_t id;                 //0 when the slot is free
+    uint64_t dueUs;
+    uint64_t runUs;             //dueUs plus the modelled latency
+    HalAlarmCallback callback;
+    void *arg;
+} HostAlarm;
+
+static uint64_t hostNowUs;
+static uint32_t hostPins;
+
+static HalPinWrite hostPinLog[HAL_HOST_PIN_LOG];
+static uint32_t hostPinLogHead;         //writes logged since the last clear
+
+static const HalI2cDevice *hostI2c[HAL_HOST_I2C_ADDRS];
+
+static HalPinWatcher hostWatchers[HAL_HOST_WATCHERS];
+static void *hostWatcherCtx[HAL_HOST_WATCHERS];
+
+static HostAlarm hostAlarms[HAL_HOST_ALARMS];
+static int32_t hostAlarmLastId;
+static HalAlarmLatency hostAlarmLatency;
+static void *hostAlarmLatencyCtx;
+
+static HalGpioIrqCallback hostGpioIrq[HAL_HOST_GPIOS];
+
+uint32_t halTimeUs32(){
+    return (uint32_t)hostNowUs;
+}
+
+uint64_t halTimeUs64(){
+    return hostNowUs;
+}
+
+//Alarms run inside halHostAdvanceUs(). In the tests that is only ever
+//called between steps of the code under test, but in Assign9_host the
+//tick hook calls it, so alarms run from the POSIX port's tick signal,
+//SIGALRM, in the middle of task code. Blocking SIGALRM keeps them out,
+//as masking interrupts does on the Pico. The state is whether it was
+//already blocked, so nested sections only unblock it at the outermost.
+uint32_t halIrqSave(){
+    sigset_t tick;
+    sigset_t old;
+
+    sigemptyset(&tick);
+    sigaddset(&tick, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &tick, &old);
+
+    return sigismember(&old, SIGALRM);
+}
+
+void halIrqRestore(uint32_t state){
+    sigset_t tick;
+
+    if(!state){
+        sigemptyset(&tick);
+        sigaddset(&tick, SIGALRM);
+        pthread_sigmask(SIG_UNBLOCK, &tick, NULL);
+    }
+}
+
+void halDmb(){
+    __sync_synchronize();
+}
+
+//every pin works in both directions here
+void halGpioInit(unsigned gpio, bool out){
+}
+
+void halGpioPutMasked(uint32_t mask, uint32_t value){
+    HalPinWrite *write = &hostPinLog[hostPinLogHead++ & (HAL_HOST_PIN_LOG - 1)];
+
+    hostPins = (hostPins & ~mask) | (value & mask);
+
+    write->timeUs = hostNowUs;
+    write->mask = mask;
+    write->value = value & mask;
+
+    for(int i = 0; i < HAL_HOST_WATCHERS && hostWatchers[i] != NULL; i++){
+        hostWatchers[i](hostWatcherCtx[i], write);
+    }
+}
+
+bool halGpioGet(unsigned gpio){
+    return (hostPins >> gpio) & 1;
+}
+
+void halGpioIrqEnable(unsigned gpio, HalGpioIrqCallback callback){
+    if(gpio < HAL_HOST_GPIOS){
+        hostGpioIrq[gpio] = callback;
+    }
+}
+
+void halI2cInit(uint32_t baud){
+}
+
+int halI2cWrite(uint8_t addr, const uint8_t *src, size_t len, bool nostop){
+    const HalI2cDevice *dev = addr < HAL_HOST_I2C_ADDRS ? hostI2c[addr] : NULL;
+
+    if(dev == NULL || dev->write == NULL){
+        return HAL_I2C_ERROR;
+    }
+    return dev->write(dev->ctx, src, len);
+}
+
+int halI2cRead(uint8_t addr, uint8_t *dst, size_t len, bool nostop){
+    const HalI2cDevice *dev = addr < HAL_HOST_I2C_ADDRS ? hostI2c[addr] : NULL;
+
+    if(dev == NULL || dev->read == NULL){
+        return HAL_I2C_ERROR;
+    }
+    return dev->read(dev->ctx, dst, len);
+}
+
+//when an alarm due at dueUs runs
+static uint64_t hostAlarmRunUs(uint64_t dueUs){
+    if(hostAlarmLatency == NULL){
+        return dueUs;
+    }
+    return dueUs + hostAlarmLatency(hostAlarmLatencyCtx, dueUs);
+}
+
+bool halAlarmStart(HalAlarm *alarm, uint32_t delayUs, HalAlarmCallback callback, void *arg){
+    alarm->id = 0;
+
+    for(int i = 0; i < HAL_HOST_ALARMS; i++){
+        if(hostAlarms[i].id == 0){
+            //ids stay positive and unique, as the SDK's do
+            hostAlarmLastId = hostAlarmLastId == INT32_MAX ? 1 : hostAlarmLastId + 1;
+            hostAlarms[i].id = hostAlarmLastId;
+            hostAlarms[i].dueUs = hostNowUs + delayUs;
+            hostAlarms[i].runUs = hostAlarmRunUs(hostAlarms[i].dueUs);
+            hostAlarms[i].callback = callback;
+            hostAlarms[i].arg = arg;
+            alarm->id = hostAlarmLastId;
+            return true;
+        }
+    }
+    return false;
+}
+
+void halAlarmCancel(HalAlarm *alarm){
+    for(int i = 0; i < HAL_HOST_ALARMS && alarm->id > 0; i++){
+        if(hostAlarms[i].id == alarm->id){
+            hostAlarms[i].id = 0;
+        }
+    }
+    alarm->id = 0;
+}
+
+//slot of the pending alarm to run first, no later than untilUs, or -1
+static int hostAlarmNext(uint64_t untilUs){
+    int next = -1;
+
+    for(int i = 0; i < HAL_HOST_ALARMS; i++){
+        if(hostAlarms[i].id != 0 && hostAlarms[i].runUs <= untilUs &&
+           (next < 0 || hostAlarms[i].runUs < hostAlarms[next].runUs)){
+            next = i;
+        }
+    }
+    return next;
+}
+
+void halHostAdvanceUs(uint64_t us){
+    uint64_t untilUs = hostNowUs + us;
+    int i;
+
+    while((i = hostAlarmNext(untilUs)) >= 0){
+        HostAlarm alarm = hostAlarms[i];
+        int64_t again;
+
+        if(alarm.runUs > hostNowUs){
+            hostNowUs = alarm.runUs;
+        }
+
+        //free the slot first, the callback may start another alarm
+        hostAlarms[i].id = 0;
+        again = alarm.callback(alarm.id, alarm.arg);
+
+        //a negative return runs it again relative to when it was due,
+        //in the same slot unless the callback took it
+        if(again < 0 && hostAlarms[i].id == 0){
+            hostAlarms[i] = alarm;
+            hostAlarms[i].dueUs = alarm.dueUs - again;
+            hostAlarms[i].runUs = hostAlarmRunUs(hostAlarms[i].dueUs);
+        }
+        else if(again > 0 && hostAlarms[i].id == 0){
+            hostAlarms[i] = alarm;
+            hostAlarms[i].dueUs = hostNowUs + again;
+            hostAlarms[i].runUs = hostAlarmRunUs(hostAlarms[i].dueUs);
+        }
+    }
+
+    hostNowUs = untilUs;
+}
+
+void halHostSetAlarmLatency(HalAlarmLatency latency, void *ctx){
+    hostAlarmLatency = latency;
+    hostAlarmLatencyCtx = ctx;
+}
+
+int halHostAlarmsPending(){
+    int pending = 0;
+
+    for(int i = 0; i < HAL_HOST_ALARMS; i++){
+        pending += hostAlarms[i].id != 0;
+    }
+    return pending;
+}
+
+//Inputs are not logged, only writes made by the code under test
+void halHostSetInput(unsigned gpio, bool level){
+    bool was = (hostPins >> gpio) & 1;
+
+    if(level){
+        hostPins |= 1u << gpio;
+    }
+    else{
+        hostPins &= ~(1u << gpio);
+    }
+
+    if(level != was && gpio < HAL_HOST_GPIOS && hostGpioIrq[gpio] != NULL){
+        hostGpioIrq[gpio](gpio);
+    }
+}
+
+uint32_t halHostPins(){
+    return hostPins;
+}
+
+size_t halHostPinLog(HalPinWrite *writes, size_t max){
+    uint32_t count = hostPinLogHead < HAL_HOST_PIN_LOG ? hostPinLogHead : HAL_HOST_PIN_LOG;
+    uint32_t first = hostPinLogHead - count;
+    size_t copied = 0;
+
+    if(count > max){
+        first += count - max;
+        count = max;
+    }
+    for(uint32_t i = first; i != first + count; i++){
+        writes[copied++] = hostPinLog[i & (HAL_HOST_PIN_LOG - 1)];
+    }
+    return copied;
+}
+
+void halHostPinLogClear(){
+    hostPinLogHead = 0;
+}
+
+void halHostI2cAttach(uint8_t addr, const HalI2cDevice *dev){
+    if(addr < HAL_HOST_I2C_ADDRS){
+        hostI2c[addr] = dev;
+    }
+}
+
+bool halHostWatchPins(HalPinWatcher watcher, void *ctx){
+    for(int i = 0; i < HAL_HOST_WATCHERS; i++){
+        if(hostWatchers[i] == NULL){
+            hostWatchers[i] = watcher;
+            hostWatcherCtx[i] = ctx;
+            return true;
+        }
+    }
+    return false;
+}
+
+//the watchers are called up to the first empty slot, so the ones after
+//the removed one move down
+void halHostUnwatchPins(HalPinWatcher watcher, void *ctx){
+    int i = 0;
+
+    while(i < HAL_HOST_WATCHERS && (hostWatchers[i] != watcher || hostWatcherCtx[i] != ctx)){
+        i++;
+    }
+    for(; i < HAL_HOST_WATCHERS; i++){
+        if(i + 1 < HAL_HOST_WATCHERS){
+            hostWatchers[i] = hostWatchers[i + 1];
+            hostWatcherCtx[i] = hostWatcherCtx[i + 1];
+        }
+        else{
+            hostWatchers[i] = NULL;
+            hostWatcherCtx[i] = NULL;
+        }
+    }
+}
+
+void halConsoleInit(){
+}
+
+//Console callback, and whether stdin has reached its end. An ended
+//stdin polls readable forever, so it is not reported again.
+static HalConsoleRxCallback hostConsoleRx;
+static void *hostConsoleRxArg;
+static bool hostConsoleEnded;
+
+int halConsoleGetChar(){
+    struct pollfd in = {.fd = STDIN_FILENO, .events = POLLIN};
+    unsigned char c;
+
+    if(hostConsoleEnded || poll(&in, 1, 0) != 1){
+        return HAL_CONSOLE_NONE;
+    }
+    if(read(STDIN_FILENO, &c, 1) == 1){
+        return c;
+    }
+    hostConsoleEnded = true;
+    return HAL_CONSOLE_NONE;
+}
+
+void halConsoleSetRxCallback(HalConsoleRxCallback callback, void *arg){
+    hostConsoleRxArg = arg;
+    hostConsoleRx = callback;
+}
+
+void halHostConsolePoll(){
+    struct pollfd in = {.fd = STDIN_FILENO, .events = POLLIN};
+
+    if(hostConsoleRx != NULL && !hostConsoleEnded && poll(&in, 1, 0) == 1){
+        hostConsoleRx(hostConsoleRxArg);
+    }
+}
+
+void halConsolePutRaw(uint8_t c){
+    putchar(c);
+}
+
+void halConsoleFlush(){
+    fflush(stdout);
+}
+
+void halPanic(const char *fmt, ...){
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    abort();
+}
@@ -0,0 +1,49 @@
+//Pico backend of the hardware layer, the parts of hal.h that keep
+//state and so cannot be inline wrappers
+
+#include "hal.h"
+
+//alarm pool for alarms started on core 1, core 0 uses the SDK default
+static alarm_pool_t *halAlarmPool1;
+
+//GPIO interrupt callback of each pin. The SDK has one callback per
+//core, so halGpioIrq() hands each edge on to the pin's own.
+static HalGpioIrqCallback halGpioIrqCallbacks[NUM_BANK0_GPIOS];
+
+static void halGpioIrq(uint gpio, uint32_t events){
+    if(gpio < NUM_BANK0_GPIOS && halGpioIrqCallbacks[gpio] != NULL){
+        halGpioIrqCallbacks[gpio](gpio);
+    }
+}
+
+void halGpioIrqEnable(unsigned gpio, HalGpioIrqCallback callback){
+    halGpioIrqCallbacks[gpio] = callback;
+    gpio_set_irq_enabled_with_callback(gpio, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, halGpioIrq);
+}
+
+bool halAlarmStart(HalAlarm *alarm, uint32_t delayUs, HalAlarmCallback callback, void *arg){
+    alarm_id_t id;
+
+    alarm->pool = get_core_num() == 1 ? halAlarmPool1 : alarm_pool_get_default();
+    alarm->id = 0;
+
+    id = alarm_pool_add_alarm_in_us(alarm->pool, delayUs, callback, arg, true);
+    if(id < 0){
+        return false;
+    }
+    if(id > 0){
+        alarm->id = id;
+    }
+    return true;
+}
+
+void halAlarmCancel(HalAlarm *alarm){
+    if(alarm->id > 0){
+        alarm_pool_cancel_alarm(alarm->pool, alarm->id);
+        alarm->id = 0;
+    }
+}
+
+void halAlarmCore1Init(unsigned hwAlarm, unsigned maxAlarms){
+    halAlarmPool1 = alarm_pool_create(hwAlarm, maxAlarms);
+}
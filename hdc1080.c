@@ -0,0 +1,188 @@
+//HDC1080 driver, see hdc1080.h
+
+#include <stdbool.h>
+
+#include "hal.h"
+#include "hrtimer.h"
+#include "hdc1080.h"
+
+//Identity of the sensor found by hdc1080Probe(), valid once
+//hdc1080Found is set
+static HDC1080Device hdc1080Dev;
+static bool hdc1080Found;
+
+//Read one 16-bit register. The identity and configuration registers
+//need no conversion time, so the read follows the pointer write
+//directly. Returns a negative value on I2C failure.
+static int hdc1080ReadReg(uint8_t reg, uint16_t *value){
+
+      uint8_t regVal[2];
+      int ret;
+
+      ret = halI2cWrite(HDC1080ADDRESS, &reg, 1, false);
+      if(ret < 0){
+          return ret;
+      }
+
+      ret = halI2cRead(HDC1080ADDRESS, regVal, 2, false);
+      if(ret < 0){
+          return ret;
+      }
+
+      *value = regVal[0]<<8|regVal[1];
+
+      return ret;
+}
+
+//Read the configuration, manufacturer ID, device ID and serial number
+//registers back to back into dev, and cache them in hdc1080Dev.
+//Returns 0 on success, a negative I2C error, or HDC1080_ERROR_ID if
+//the manufacturer or device ID does not match an HDC1080.
+int hdc1080Probe(HDC1080Device *dev){
+
+      static const uint8_t snRegs[3] = {HDC1080SN1, HDC1080SN2, HDC1080SN3};
+      int ret;
+
+      ret = hdc1080ReadReg(HDC1080DEVICEIDREG, &dev->mfID);
+      if(ret >= 0){
+          ret = hdc1080ReadReg(HDC1080DEVICEID, &dev->deviceID);
+      }
+      if(ret < 0){
+          return ret;
+      }
+      if(dev->mfID != HDC1080_MFID || dev->deviceID != HDC1080_DEVID){
+          return HDC1080_ERROR_ID;
+      }
+
+      ret = hdc1080ReadReg(HDC1080CONFIGREG, &dev->config);
+      for(int i = 0; i < 3 && ret >= 0; i++){
+          ret = hdc1080ReadReg(snRegs[i], &dev->serial[i]);
+      }
+      if(ret < 0){
+          return ret;
+      }
+
+      hdc1080Dev = *dev;
+      hdc1080Found = true;
+
+      return 0;
+}
+
+//Copy the identity read by the last successful hdc1080Probe() into dev.
+//Returns false if no probe has succeeded yet.
+bool hdc1080Identity(HDC1080Device *dev){
+
+      if(!hdc1080Found){
+          return false;
+      }
+
+      *dev = hdc1080Dev;
+      return true;
+}
+
+//Configuration register value written to the sensor and the matching
+//acquisition time, starting at the power-on 14-bit resolutions
+static uint16_t hdc1080Config = HDC1080_MODE_ACQ;
+static uint32_t hdc1080AcqUs = HDC1080_TEMP14_US + HDC1080_HUM14_US;
+
+//write hdc1080Config to the configuration register
+static int hdc1080WriteConfig(){
+
+      uint8_t cfWrite[3] = {HDC1080CONFIGREG, hdc1080Config >> 8, hdc1080Config & 0xFF};
+
+      return halI2cWrite(HDC1080ADDRESS, cfWrite, 3, false);
+}
+
+//Put the HDC1080 in acquisition mode at HDC1080_TEMP_BITS and
+//HDC1080_HUM_BITS, so a trigger on the temperature register converts
+//both. Called once before the first reading.
+int hdc1080Init(){
+      return hdc1080SetResolution(HDC1080_TEMP_BITS, HDC1080_HUM_BITS);
+}
+
+//Set the temperature (11 or 14) and humidity (8, 11 or 14) resolution
+//in bits. Lower resolutions convert faster, and the wait in
+//readTempHumidity() follows the selected conversion time.
+//Returns HDC1080_ERROR_RESOLUTION for an unsupported resolution or a
+//negative I2C error.
+int hdc1080SetResolution(int tempBits, int humBits){
+
+      uint16_t config = HDC1080_MODE_ACQ;
+      uint32_t acqUs;
+
+      if(tempBits == 14){
+          acqUs = HDC1080_TEMP14_US;
+      }
+      else if(tempBits == 11){
+          config |= HDC1080_TRES_11;
+          acqUs = HDC1080_TEMP11_US;
+      }
+      else{
+          return HDC1080_ERROR_RESOLUTION;
+      }
+
+      if(humBits == 14){
+          acqUs += HDC1080_HUM14_US;
+      }
+      else if(humBits == 11){
+          config |= HDC1080_HRES_11;
+          acqUs += HDC1080_HUM11_US;
+      }
+      else if(humBits == 8){
+          config |= HDC1080_HRES_8;
+          acqUs += HDC1080_HUM8_US;
+      }
+      else{
+          return HDC1080_ERROR_RESOLUTION;
+      }
+
+      hdc1080Config = config;
+      hdc1080AcqUs = acqUs;
+
+      return hdc1080WriteConfig();
+}
+
+//Round a value in hundredths to whole units, halves away from zero
+int centiRound(int centi){
+      return centi >= 0 ? (centi + 50) / 100 : (centi - 50) / 100;
+}
+
+//This function reads the current temperature and humidity from the
+//HDC1080 in one acquisition: one pointer write to the temperature
+//register triggers both conversions and one 4-byte read returns
+//temperature then humidity. Only waits the conversion time for the
+//selected resolution, and a little more if the sensor NACKs because
+//it is not done yet.
+//Returns a negative value and leaves reading alone on failure.
+int readTempHumidity(HDC1080Reading *reading){
+
+      uint8_t acq[4];
+      uint8_t tempRegVal = HDC1080TEMPREG;
+      int ret;
+      int retries = HDC1080_READ_RETRIES;
+
+      //write block to trigger the acquisition
+      ret = halI2cWrite(HDC1080ADDRESS, &tempRegVal, 1, false);
+      if(ret < 0){
+          return ret;
+      }
+
+      //wait the conversion time
+      hrSleepUs(hdc1080AcqUs);
+
+      //read block for temperature and humidity
+      ret = halI2cRead(HDC1080ADDRESS, acq, 4, false);
+      while(ret < 0 && retries-- > 0){
+          hrSleepUs(HDC1080_RETRY_US);
+          ret = halI2cRead(HDC1080ADDRESS, acq, 4, false);
+      }
+      if(ret < 0){
+          return ret;
+      }
+
+      reading->tempC100 = hdc1080TempC100(acq[0]<<8|acq[1]);
+      reading->tempF100 = hdc1080TempF100(acq[0]<<8|acq[1]);
+      reading->humidity100 = hdc1080Humidity100(acq[2]<<8|acq[3]);
+
+      return ret;
+}
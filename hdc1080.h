@@ -0,0 +1,97 @@
+//HDC1080 temperature and humidity sensor driver, on the I2C bus of the
+//hardware layer. Readings are converted with integer math only.
+
+#ifndef HDC1080_H
+#define HDC1080_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// I2C reserves some addresses for special purposes. We exclude these from the scan.
+// These are any addresses of the form 000 0xxx or 111 1xxx
+#define HDC1080TEMPREG 0x00
+#define HDC1080HUMREG 0x01
+#define HDC1080CONFIGREG 0x02
+#define HDC1080ADDRESS 0x40
+#define HDC1080SN1 0xFB
+#define HDC1080SN2 0xFC
+#define HDC1080SN3 0xFD
+#define HDC1080DEVICEIDREG 0xFE
+#define HDC1080DEVICEID 0xFF
+
+//Expected identity register values
+#define HDC1080_MFID 0x5449        //"TI" in the manufacturer ID register
+#define HDC1080_DEVID 0x1050       //device ID register
+
+//returned by hdc1080Probe() when the identity registers do not match
+#define HDC1080_ERROR_ID (-100)
+
+//returned by hdc1080SetResolution() for an unsupported resolution
+#define HDC1080_ERROR_RESOLUTION (-101)
+
+//Configuration register bits
+#define HDC1080_MODE_ACQ 0x1000    //acquire temperature and humidity in sequence
+#define HDC1080_TRES_11 0x0400     //11-bit temperature, 14-bit when clear
+#define HDC1080_HRES_11 0x0100     //11-bit humidity
+#define HDC1080_HRES_8 0x0200      //8-bit humidity, 14-bit when both clear
+
+//Conversion times in microseconds from the datasheet
+#define HDC1080_TEMP14_US 6350
+#define HDC1080_TEMP11_US 3650
+#define HDC1080_HUM14_US 6500
+#define HDC1080_HUM11_US 3850
+#define HDC1080_HUM8_US 2500
+
+//Resolution set at startup, in bits. Lower it to sample faster when
+//whole degrees and percent are enough.
+#define HDC1080_TEMP_BITS 14
+#define HDC1080_HUM_BITS 14
+
+//extra HDC1080_RETRY_US waits allowed when the sensor NACKs a read
+//because the conversion is not finished yet
+#define HDC1080_READ_RETRIES 3
+#define HDC1080_RETRY_US 500
+
+typedef struct {
+    uint16_t config;        //configuration register at probe time
+    uint16_t mfID;          //manufacturer ID
+    uint16_t deviceID;      //device ID
+    uint16_t serial[3];     //serial number, most significant block first
+} HDC1080Device;
+
+//One reading in hundredths, so 2345 is 23.45 C
+typedef struct {
+    int tempC100;
+    int tempF100;
+    int humidity100;
+} HDC1080Reading;
+
+int hdc1080Probe(HDC1080Device *dev);
+bool hdc1080Identity(HDC1080Device *dev);
+int hdc1080Init();
+int hdc1080SetResolution(int tempBits, int humBits);
+int readTempHumidity(HDC1080Reading *reading);
+int centiRound(int centi);
+
+//Raw to unit conversions in integer math, so no soft-float calls on
+//the M0+. Each scales the 16-bit code by the full-scale range in
+//hundredths and rounds with a shift: value = raw * range / 2^16.
+//The products stay under 2^31 for every raw code.
+
+//temperature in hundredths of a degree C, -40 to 125 C
+static inline int hdc1080TempC100(uint16_t raw){
+      return (int)(((uint32_t)raw * 16500 + 32768) >> 16) - 4000;
+}
+
+//temperature in hundredths of a degree F, computed from the raw code
+//rather than from rounded C so no precision is lost
+static inline int hdc1080TempF100(uint16_t raw){
+      return (int)(((uint32_t)raw * 29700 + 32768) >> 16) - 4000;
+}
+
+//relative humidity in hundredths of a percent
+static inline int hdc1080Humidity100(uint16_t raw){
+      return (int)(((uint32_t)raw * 10000 + 32768) >> 16);
+}
+
+#endif
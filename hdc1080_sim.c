@@ -0,0 +1,265 @@
+//Behavioral HDC1080 model for the host hardware layer, see hdc1080_sim.h.
+//Register layout, resolutions and conversion times follow the datasheet.
+
+#include <string.h>
+
+#include "hdc1080_sim.h"
+
+//registers
+#define SIM_REG_TEMP 0x00
+#define SIM_REG_HUM 0x01
+#define SIM_REG_CONFIG 0x02
+#define SIM_REG_SN1 0xFB
+#define SIM_REG_SN3 0xFD
+#define SIM_REG_MFID 0xFE
+#define SIM_REG_DEVID 0xFF
+
+#define SIM_MFID 0x5449
+#define SIM_DEVID 0x1050
+
+//configuration bits
+#define SIM_CONFIG_RST 0x8000           //software reset, reads back 0
+#define SIM_CONFIG_MODE 0x1000          //acquire both values in sequence
+#define SIM_CONFIG_TRES 0x0400          //11-bit temperature
+#define SIM_CONFIG_HRES 0x0300          //humidity resolution field
+#define SIM_CONFIG_HRES_11 0x0100
+#define SIM_CONFIG_HRES_8 0x0200
+#define SIM_CONFIG_WRITABLE 0x3700      //heater, mode and resolutions
+#define SIM_CONFIG_POWER_ON 0x1000
+
+//conversion times in microseconds
+#define SIM_TEMP14_US 6350
+#define SIM_TEMP11_US 3650
+#define SIM_HUM14_US 6500
+#define SIM_HUM11_US 3850
+#define SIM_HUM8_US 2500
+
+//default environment
+#define SIM_DEFAULT_TEMP_C100 2500
+#define SIM_DEFAULT_HUM100 5000
+
+static void simConstantWaveform(void *ctx, uint64_t timeUs, int32_t *tempC100, int32_t *humidity100){
+    *tempC100 = SIM_DEFAULT_TEMP_C100;
+    *humidity100 = SIM_DEFAULT_HUM100;
+}
+
+//conversion time and result mask of the temperature at the current resolution
+static uint32_t simTempUs(const HDC1080Sim *sim, uint16_t *mask){
+    if(sim->config & SIM_CONFIG_TRES){
+        *mask = 0xFFE0;
+        return SIM_TEMP11_US;
+    }
+    *mask = 0xFFFC;
+    return SIM_TEMP14_US;
+}
+
+//conversion time and result mask of the humidity at the current resolution
+static uint32_t simHumUs(const HDC1080Sim *sim, uint16_t *mask){
+    switch(sim->config & SIM_CONFIG_HRES){
+        case SIM_CONFIG_HRES_11:
+            *mask = 0xFFE0;
+            return SIM_HUM11_US;
+        case SIM_CONFIG_HRES_8:
+            *mask = 0xFF00;
+            return SIM_HUM8_US;
+        default:
+            *mask = 0xFFFC;
+            return SIM_HUM14_US;
+    }
+}
+
+//16-bit output codes, the inverse of the datasheet formulas, clamped
+//to the code range
+static uint16_t simTempCode(int32_t tempC100){
+    int64_t code = ((int64_t)(tempC100 + 4000) * 65536 + 8250) / 16500;
+
+    return code < 0 ? 0 : code > 0xFFFF ? 0xFFFF : code;
+}
+
+static uint16_t simHumCode(int32_t humidity100){
+    int64_t code = ((int64_t)humidity100 * 65536 + 5000) / 10000;
+
+    return code < 0 ? 0 : code > 0xFFFF ? 0xFFFF : code;
+}
+
+//start a conversion triggered by a pointer write to reg
+static void simStartConversion(HDC1080Sim *sim, uint8_t reg){
+    uint16_t mask;
+    uint32_t us;
+
+    if(reg == SIM_REG_TEMP){
+        us = simTempUs(sim, &mask);
+        if(sim->config & SIM_CONFIG_MODE){
+            us += simHumUs(sim, &mask);
+        }
+    }
+    else{
+        us = simHumUs(sim, &mask);
+    }
+
+    sim->converting = true;
+    sim->convertReg = reg;
+    sim->readyUs = halTimeUs64() + us;
+}
+
+//latch the result of a finished conversion, sampling the environment
+//at the moment it finished
+static void simFinishConversion(HDC1080Sim *sim){
+    int32_t tempC100;
+    int32_t humidity100;
+    uint16_t tempMask;
+    uint16_t humMask;
+    uint16_t temp;
+    uint16_t hum;
+
+    sim->waveform(sim->waveformCtx, sim->readyUs, &tempC100, &humidity100);
+    simTempUs(sim, &tempMask);
+    simHumUs(sim, &humMask);
+    temp = simTempCode(tempC100) & tempMask;
+    hum = simHumCode(humidity100) & humMask;
+
+    if(sim->convertReg == SIM_REG_TEMP){
+        sim->result[0] = temp >> 8;
+        sim->result[1] = temp & 0xFF;
+        sim->result[2] = hum >> 8;
+        sim->result[3] = hum & 0xFF;
+        sim->resultLen = (sim->config & SIM_CONFIG_MODE) ? 4 : 2;
+    }
+    else{
+        sim->result[0] = hum >> 8;
+        sim->result[1] = hum & 0xFF;
+        sim->resultLen = 2;
+    }
+
+    sim->converting = false;
+    sim->stats.conversions++;
+}
+
+//Apply the injected faults to a transfer. Returns 0 to let it through
+//or the error to fail it with.
+static int simFault(HDC1080Sim *sim){
+    if(sim->stuck){
+        sim->stats.timeouts++;
+        return HAL_I2C_TIMEOUT;
+    }
+    if(sim->nackCount > 0){
+        sim->nackCount--;
+        sim->stats.nacks++;
+        return HAL_I2C_ERROR;
+    }
+    return 0;
+}
+
+static int simWrite(void *ctx, const uint8_t *src, size_t len){
+    HDC1080Sim *sim = ctx;
+    int fault = simFault(sim);
+    uint16_t value;
+
+    if(fault != 0){
+        return fault;
+    }
+    sim->stats.writes++;
+    if(len == 0){
+        return 0;
+    }
+
+    sim->pointer = src[0];
+
+    if(len == 1 && (sim->pointer == SIM_REG_TEMP || sim->pointer == SIM_REG_HUM)){
+        simStartConversion(sim, sim->pointer);
+    }
+    else if(len >= 3 && sim->pointer == SIM_REG_CONFIG){
+        value = src[1] << 8 | src[2];
+        sim->config = (value & SIM_CONFIG_RST) ? SIM_CONFIG_POWER_ON : (value & SIM_CONFIG_WRITABLE);
+    }
+
+    return len;
+}
+
+static int simRead(void *ctx, uint8_t *dst, size_t len){
+    HDC1080Sim *sim = ctx;
+    int fault = simFault(sim);
+    uint8_t bytes[4];
+    size_t count = 0;
+    uint16_t value;
+
+    if(fault != 0){
+        return fault;
+    }
+
+    if(sim->pointer == SIM_REG_TEMP || sim->pointer == SIM_REG_HUM){
+        //The part NACKs its address until the conversion is done, and
+        //has nothing to return before the first one
+        if((sim->converting && halTimeUs64() < sim->readyUs) ||
+           (!sim->converting && sim->resultLen == 0)){
+            sim->stats.nacks++;
+            return HAL_I2C_ERROR;
+        }
+        if(sim->converting){
+            simFinishConversion(sim);
+        }
+        memcpy(bytes, sim->result, sim->resultLen);
+        count = sim->resultLen;
+    }
+    else{
+        if(sim->pointer == SIM_REG_CONFIG){
+            value = sim->config;
+        }
+        else if(sim->pointer >= SIM_REG_SN1 && sim->pointer <= SIM_REG_SN3){
+            value = sim->serial[sim->pointer - SIM_REG_SN1];
+        }
+        else if(sim->pointer == SIM_REG_MFID){
+            value = SIM_MFID;
+        }
+        else if(sim->pointer == SIM_REG_DEVID){
+            value = SIM_DEVID;
+        }
+        else{
+            value = 0xFFFF;
+        }
+        bytes[0] = value >> 8;
+        bytes[1] = value & 0xFF;
+        count = 2;
+    }
+
+    //past the end of the data the bus reads as pulled high
+    for(size_t i = 0; i < len; i++){
+        dst[i] = (i < count ? bytes[i] : 0xFF) ^ sim->corruptMask;
+    }
+    sim->corruptMask = 0;
+    sim->stats.reads++;
+
+    return len;
+}
+
+void hdc1080SimAttach(HDC1080Sim *sim, uint8_t addr){
+    memset(sim, 0, sizeof(*sim));
+
+    sim->dev.write = simWrite;
+    sim->dev.read = simRead;
+    sim->dev.ctx = sim;
+    sim->config = SIM_CONFIG_POWER_ON;
+    sim->serial[0] = 0x0123;
+    sim->serial[1] = 0x4567;
+    sim->serial[2] = 0x8900;
+    sim->waveform = simConstantWaveform;
+
+    halHostI2cAttach(addr, &sim->dev);
+}
+
+void hdc1080SimSetWaveform(HDC1080Sim *sim, HDC1080SimWaveform waveform, void *ctx){
+    sim->waveform = waveform != NULL ? waveform : simConstantWaveform;
+    sim->waveformCtx = ctx;
+}
+
+void hdc1080SimInjectNack(HDC1080Sim *sim, uint32_t count){
+    sim->nackCount = count;
+}
+
+void hdc1080SimSetStuck(HDC1080Sim *sim, bool stuck){
+    sim->stuck = stuck;
+}
+
+void hdc1080SimCorruptNext(HDC1080Sim *sim, uint8_t mask){
+    sim->corruptMask = mask;
+}
@@ -0,0 +1,80 @@
+//Behavioral model of the HDC1080 for the host hardware layer. Attached
+//at the sensor's address with hdc1080SimAttach(), it answers the
+//driver in Assign9.c the way the real part does:
+//
+//  - a one byte write sets the register pointer, and pointing at 0x00
+//    or 0x01 starts a conversion (both values in acquisition mode)
+//  - reads NACK until the conversion time for the configured
+//    resolutions has passed on the virtual clock, and before the first
+//    conversion has been triggered
+//  - 0x02 is the configuration register, 0xFB-0xFF the serial and ID
+//
+//Temperature and humidity come from a waveform callback sampled when
+//each conversion finishes, so runs are repeatable. Faults can be
+//injected to exercise the driver's retry paths.
+
+#ifndef HDC1080_SIM_H
+#define HDC1080_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+//Environment at timeUs, in hundredths of a degree C and of a percent
+typedef void (*HDC1080SimWaveform)(void *ctx, uint64_t timeUs, int32_t *tempC100, int32_t *humidity100);
+
+//transfer counts, for benchmarking the driver
+typedef struct {
+    uint32_t writes;
+    uint32_t reads;
+    uint32_t nacks;             //transfers NACKed, injected NACKs included
+    uint32_t timeouts;          //transfers timed out on a stuck bus
+    uint32_t conversions;
+} HDC1080SimStats;
+
+typedef struct {
+    HalI2cDevice dev;
+
+    //registers
+    uint8_t pointer;
+    uint16_t config;
+    uint16_t serial[3];
+
+    //conversion in progress or last finished. result holds temperature
+    //then humidity, resultLen the bytes a read returns, 0 until the
+    //first conversion has finished.
+    bool converting;
+    uint64_t readyUs;
+    uint8_t convertReg;
+    uint8_t result[4];
+    uint8_t resultLen;
+
+    HDC1080SimWaveform waveform;
+    void *waveformCtx;
+
+    //faults
+    uint32_t nackCount;         //transfers left to NACK
+    bool stuck;                 //every transfer times out
+    uint8_t corruptMask;        //XORed into every byte of the next read
+
+    HDC1080SimStats stats;
+} HDC1080Sim;
+
+//Reset sim to power-on state and attach it at addr. The environment is
+//25.00 C and 50.00 % until a waveform is set.
+void hdc1080SimAttach(HDC1080Sim *sim, uint8_t addr);
+
+//sample the environment from waveform from now on
+void hdc1080SimSetWaveform(HDC1080Sim *sim, HDC1080SimWaveform waveform, void *ctx);
+
+//NACK the next count transfers
+void hdc1080SimInjectNack(HDC1080Sim *sim, uint32_t count);
+
+//hold the bus so every transfer times out, until called with false
+void hdc1080SimSetStuck(HDC1080Sim *sim, bool stuck);
+
+//flip the bits in mask in every byte of the next read
+void hdc1080SimCorruptNext(HDC1080Sim *sim, uint8_t mask);
+
+#endif
@@ -0,0 +1,44 @@
+//High resolution timer service, see hrtimer.h
+
+#include "hrtimer.h"
+
+//alarm callback shared by every HrTimer. Periodic timers are
+//rescheduled relative to when this call was due.
+static int64_t hrTimerAlarm(int32_t id, void *userData){
+    HrTimer *timer = userData;
+
+    if(timer->callback(timer->arg) && timer->periodUs != 0){
+        return -(int64_t)timer->periodUs;
+    }
+
+    timer->alarm.id = 0;
+    return 0;
+}
+
+//The alarm interrupt runs on the core that starts the timer. Masking it
+//while the alarm is added and its id stored means a short delay cannot
+//fire and clear the id before it is written, which would leave a
+//stale id for hrTimerCancel() to cancel.
+bool hrTimerStart(HrTimer *timer, uint32_t delayUs, uint32_t periodUs, HrTimerCallback callback, void *arg){
+    uint32_t irq;
+    bool started;
+
+    timer->periodUs = periodUs;
+    timer->callback = callback;
+    timer->arg = arg;
+
+    irq = halIrqSave();
+    started = halAlarmStart(&timer->alarm, delayUs, hrTimerAlarm, timer);
+    halIrqRestore(irq);
+
+    return started;
+}
+
+//masked for the same reason, so the id cannot be cleared by a last
+//callback between being read and being cancelled
+void hrTimerCancel(HrTimer *timer){
+    uint32_t irq = halIrqSave();
+
+    halAlarmCancel(&timer->alarm);
+    halIrqRestore(irq);
+}
@@ -0,0 +1,36 @@
+//High resolution timer service. Microsecond timing on the hardware
+//alarms, independent of the RTOS tick. Timers run their callback from
+//the alarm interrupt of the core that started them.
+
+#ifndef HRTIMER_H
+#define HRTIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+//Callbacks run in interrupt context and return false to stop a
+//periodic timer
+typedef bool (*HrTimerCallback)(void *arg);
+
+typedef struct {
+    HalAlarm alarm;             //pending alarm, id 0 when idle
+    uint32_t periodUs;          //0 for one shot, callbacks may change it
+    HrTimerCallback callback;
+    void *arg;
+} HrTimer;
+
+//Run callback after delayUs, then every periodUs until it returns
+//false or the timer is cancelled. periodUs of 0 is a one shot.
+//Returns false if no hardware alarm slot is free.
+bool hrTimerStart(HrTimer *timer, uint32_t delayUs, uint32_t periodUs, HrTimerCallback callback, void *arg);
+
+//stop a timer, the callback will not run again
+void hrTimerCancel(HrTimer *timer);
+
+//Block the calling task for us microseconds. It blocks on FreeRTOS, so
+//it is defined with the tasks in Assign9.c.
+void hrSleepUs(uint32_t us);
+
+#endif
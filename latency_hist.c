@@ -0,0 +1,29 @@
+//Latency histograms, see latency_hist.h
+
+#include "latency_hist.h"
+
+void histAdd(LatencyHist *hist, uint32_t us){
+    unsigned bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+
+    if(bucket >= LAT_BUCKETS){
+        bucket = LAT_BUCKETS - 1;
+    }
+    hist->counts[bucket]++;
+    hist->total++;
+    if(us > hist->maxUs){
+        hist->maxUs = us;
+    }
+}
+
+uint32_t histPercentile(const LatencyHist *hist, uint32_t percent){
+    uint32_t rank = ((uint64_t)hist->total * percent + 99) / 100;
+    uint32_t seen = 0;
+
+    for(unsigned b = 0; b < LAT_BUCKETS - 1; b++){
+        seen += hist->counts[b];
+        if(seen >= rank){
+            return (1u << b) - 1;
+        }
+    }
+    return hist->maxUs;
+}
@@ -0,0 +1,24 @@
+//Histograms of microsecond times in power of two buckets, cheap enough
+//to fill from an interrupt. Each histogram must have a single writer.
+
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+
+//bucket b counts times up to 2^b - 1 us, the last one everything longer
+#define LAT_BUCKETS 25
+
+typedef struct {
+    uint32_t counts[LAT_BUCKETS];
+    uint32_t total;
+    uint32_t maxUs;
+} LatencyHist;
+
+//Add one time to a histogram
+void histAdd(LatencyHist *hist, uint32_t us);
+
+//Upper bound in us of the bucket holding the given percentile
+uint32_t histPercentile(const LatencyHist *hist, uint32_t percent);
+
+#endif
@@ -0,0 +1,152 @@
+//28BYJ-48 + ULN2003 model for the host hardware layer, see motor_sim.h
+
+#include <string.h>
+
+#include "motor_sim.h"
+
+//no coil energized, the rotor is free
+#define SIM_PHASE_OFF (-1)
+
+//a coil pattern that is not a phase, opposite coils or three or more on
+#define SIM_PHASE_BAD (-2)
+
+//Half step phase of each coil pattern, bit 0 is IN1. The order matches
+//the step engine's half step table, IN1, IN1+IN2, IN2 and so on.
+static const int8_t simPhaseOf[16] = {
+    SIM_PHASE_OFF,  //0000
+    0,              //0001 IN1
+    2,              //0010 IN2
+    1,              //0011 IN1 IN2
+    4,              //0100 IN3
+    SIM_PHASE_BAD,  //0101
+    3,              //0110 IN2 IN3
+    SIM_PHASE_BAD,  //0111
+    6,              //1000 IN4
+    7,              //1001 IN1 IN4
+    SIM_PHASE_BAD,  //1010
+    SIM_PHASE_BAD,  //1011
+    5,              //1100 IN3 IN4
+    SIM_PHASE_BAD,  //1101
+    SIM_PHASE_BAD,  //1110
+    SIM_PHASE_BAD,  //1111
+};
+
+//add the time since the last write to every coil that was on
+static void simIntegrate(MotorSim *sim, uint64_t nowUs){
+    for(int coil = 0; coil < 4; coil++){
+        if(sim->coils & (1u << coil)){
+            sim->coilUs[coil] += nowUs - sim->lastWriteUs;
+        }
+    }
+    sim->lastWriteUs = nowUs;
+}
+
+//the coils now pull towards phase, move the rotor if it can follow
+static void simStep(MotorSim *sim, int8_t phase, uint64_t nowUs){
+    int delta = (phase - sim->rotorPhase) & 7;
+    uint32_t perHalfStep;
+
+    //shortest way round, -3 to 4 half steps
+    if(delta > 4){
+        delta -= 8;
+    }
+    if(delta == 0){
+        return;
+    }
+
+    //more than a full step away the rotor is pulled both ways or not
+    //at all, so it stays
+    if(delta > 2 || delta < -2){
+        sim->stats.illegal++;
+        return;
+    }
+
+    perHalfStep = (nowUs - sim->lastStepUs) / (delta > 0 ? delta : -delta);
+    if(sim->moved && perHalfStep < sim->minHalfStepUs){
+        sim->stats.overSpeed++;
+        return;
+    }
+    if(sim->moved && (sim->stats.minHalfStepUs == 0 || perHalfStep < sim->stats.minHalfStepUs)){
+        sim->stats.minHalfStepUs = perHalfStep;
+    }
+
+    sim->rotorPhase = phase;
+    sim->position += delta;
+    sim->lastStepUs = nowUs;
+    sim->moved = true;
+    sim->stats.steps++;
+}
+
+static void simPinWrite(void *ctx, const HalPinWrite *write){
+    MotorSim *sim = ctx;
+    uint8_t coils = 0;
+    int8_t phase;
+
+    if(!(write->mask & (sim->pinMasks[0] | sim->pinMasks[1] | sim->pinMasks[2] | sim->pinMasks[3]))){
+        return;
+    }
+
+    simIntegrate(sim, write->timeUs);
+
+    for(int coil = 0; coil < 4; coil++){
+        bool on = (write->mask & sim->pinMasks[coil]) ? (write->value & sim->pinMasks[coil]) != 0
+                                                      : (sim->coils & (1u << coil)) != 0;
+        if(on){
+            coils |= 1u << coil;
+        }
+    }
+    if(coils == sim->coils){
+        return;
+    }
+    sim->coils = coils;
+
+    phase = simPhaseOf[coils];
+    if(phase == SIM_PHASE_BAD){
+        sim->stats.illegal++;
+    }
+    else if(phase != SIM_PHASE_OFF && !sim->aligned){
+        sim->rotorPhase = phase;
+        sim->aligned = true;
+    }
+    else if(phase != SIM_PHASE_OFF){
+        simStep(sim, phase, write->timeUs);
+    }
+}
+
+bool motorSimAttach(MotorSim *sim, const uint8_t pins[4], uint32_t minHalfStepUs){
+    memset(sim, 0, sizeof(*sim));
+
+    for(int coil = 0; coil < 4; coil++){
+        sim->pinMasks[coil] = 1u << pins[coil];
+    }
+    sim->minHalfStepUs = minHalfStepUs != 0 ? minHalfStepUs : MOTOR_SIM_DEFAULT_MIN_HALF_STEP_US;
+    sim->lastWriteUs = halTimeUs64();
+
+    return halHostWatchPins(simPinWrite, sim);
+}
+
+void motorSimDetach(MotorSim *sim){
+    halHostUnwatchPins(simPinWrite, sim);
+}
+
+int32_t motorSimPosition(const MotorSim *sim){
+    return sim->position;
+}
+
+int32_t motorSimAngleMilliDeg(const MotorSim *sim){
+    int32_t halfSteps = sim->position % MOTOR_SIM_HALF_STEPS_PER_REV;
+
+    if(halfSteps < 0){
+        halfSteps += MOTOR_SIM_HALF_STEPS_PER_REV;
+    }
+    return (int64_t)halfSteps * 360000 / MOTOR_SIM_HALF_STEPS_PER_REV;
+}
+
+uint64_t motorSimCoilUs(const MotorSim *sim, int coil){
+    uint64_t us = sim->coilUs[coil];
+
+    if(sim->coils & (1u << coil)){
+        us += halTimeUs64() - sim->lastWriteUs;
+    }
+    return us;
+}
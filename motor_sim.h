@@ -0,0 +1,74 @@
+//Model of a 28BYJ-48 stepper on a ULN2003 driver for the host hardware
+//layer. It watches the writes to the four driver inputs and moves a
+//virtual shaft the way the real motor would:
+//
+//  - each coil pattern is a phase of the 8 phase half step cycle, so
+//    half step, full step and wave drive sequences all decode
+//  - the rotor follows a change of up to two half steps (one full
+//    step). Anything further, or a pattern that is not a phase, is
+//    counted as illegal and the rotor stays put.
+//  - a step that comes sooner than minHalfStepUs per half step after
+//    the last one is counted as over-speed and missed, as a real motor
+//    would stall
+//
+//The time each coil is energized is integrated on the virtual clock.
+
+#ifndef MOTOR_SIM_H
+#define MOTOR_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+//half steps per output shaft turn, 64 per motor turn through the 1:64
+//gearbox. A full step turn is half as many steps.
+#define MOTOR_SIM_HALF_STEPS_PER_REV 4096
+
+//Fastest half step the model follows, about 18 rpm, a little above the
+//28BYJ-48's rated 15 rpm at 5 V
+#define MOTOR_SIM_DEFAULT_MIN_HALF_STEP_US 800
+
+typedef struct {
+    uint32_t steps;             //steps the rotor followed
+    uint32_t illegal;           //jumps of more than a full step or bad patterns
+    uint32_t overSpeed;         //steps missed for coming too soon
+    uint32_t minHalfStepUs;     //shortest time per half step followed
+} MotorSimStats;
+
+typedef struct {
+    uint32_t pinMasks[4];       //IN1-IN4
+    uint32_t minHalfStepUs;
+
+    uint8_t coils;              //energized coils, bit 0 is IN1
+    int8_t rotorPhase;          //half step phase the rotor sits at
+    bool aligned;               //rotorPhase has been set by a first phase
+    int32_t position;           //half steps, positive is rising phase
+    bool moved;                 //the rotor has made a step
+    uint64_t lastStepUs;
+    uint64_t lastWriteUs;
+    uint64_t coilUs[4];         //energized time of each coil up to lastWriteUs
+
+    MotorSimStats stats;
+} MotorSim;
+
+//Reset sim to position 0 and start watching pins (IN1-IN4). The rotor
+//is taken to sit at the first phase energized. minHalfStepUs is the
+//fastest half step the motor can follow, 0 selects
+//MOTOR_SIM_DEFAULT_MIN_HALF_STEP_US.
+//Returns false if the pin watcher cannot be registered.
+bool motorSimAttach(MotorSim *sim, const uint8_t pins[4], uint32_t minHalfStepUs);
+
+//stop watching the pins, the model keeps its state
+void motorSimDetach(MotorSim *sim);
+
+//shaft position in half steps since attach
+int32_t motorSimPosition(const MotorSim *sim);
+
+//shaft angle in thousandths of a degree, within one turn
+int32_t motorSimAngleMilliDeg(const MotorSim *sim);
+
+//microseconds coil (0-3, IN1-IN4) has been energized, up to now
+uint64_t motorSimCoilUs(const MotorSim *sim, int coil);
+
+#endif
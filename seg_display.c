@@ -0,0 +1,149 @@
+//7-segment display scan, see seg_display.h
+
+#include <stdbool.h>
+
+#include "hal.h"
+#include "hrtimer.h"
+#include "seg_display.h"
+
+const uint32_t segGlyphMasks[GLYPH_COUNT] = {
+    [GLYPH_0] = SEG_A_BIT | SEG_B_BIT | SEG_C_BIT | SEG_D_BIT | SEG_E_BIT | SEG_F_BIT,
+    [GLYPH_1] = SEG_B_BIT | SEG_C_BIT,
+    [GLYPH_2] = SEG_A_BIT | SEG_B_BIT | SEG_D_BIT | SEG_E_BIT | SEG_G_BIT,
+    [GLYPH_3] = SEG_A_BIT | SEG_B_BIT | SEG_C_BIT | SEG_D_BIT | SEG_G_BIT,
+    [GLYPH_4] = SEG_B_BIT | SEG_C_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_5] = SEG_A_BIT | SEG_C_BIT | SEG_D_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_6] = SEG_A_BIT | SEG_C_BIT | SEG_D_BIT | SEG_E_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_7] = SEG_A_BIT | SEG_B_BIT | SEG_C_BIT,
+    [GLYPH_8] = SEG_A_BIT | SEG_B_BIT | SEG_C_BIT | SEG_D_BIT | SEG_E_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_9] = SEG_A_BIT | SEG_B_BIT | SEG_C_BIT | SEG_D_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_E] = SEG_A_BIT | SEG_D_BIT | SEG_E_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_P] = SEG_A_BIT | SEG_B_BIT | SEG_E_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_H] = SEG_B_BIT | SEG_C_BIT | SEG_E_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_F] = SEG_A_BIT | SEG_E_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_b] = SEG_C_BIT | SEG_D_BIT | SEG_E_BIT | SEG_F_BIT | SEG_G_BIT,
+    [GLYPH_C] = SEG_A_BIT | SEG_D_BIT | SEG_E_BIT | SEG_F_BIT,
+    [GLYPH_O] = SEG_A_BIT | SEG_B_BIT | SEG_C_BIT | SEG_D_BIT | SEG_E_BIT | SEG_F_BIT,
+    [GLYPH_r] = SEG_E_BIT | SEG_G_BIT,
+    [GLYPH_BLANK] = 0,
+};
+
+static const uint8_t segStatusGlyphs[SEG_STATUS_LAST - SEG_STATUS_FIRST + 1][2] = {
+    {GLYPH_E, GLYPH_r},     //992 sensor error
+    {GLYPH_O, GLYPH_F},     //993 queue overflow
+    {GLYPH_P, GLYPH_P},     //994 moving on temperature
+    {GLYPH_H, GLYPH_H},     //995 moving on humidity
+    {GLYPH_F, GLYPH_F},     //996 clockwise
+    {GLYPH_b, GLYPH_b},     //997 counter-clockwise
+    {GLYPH_C, GLYPH_C},     //998 test rotation
+    {GLYPH_E, GLYPH_E},     //999 emergency stop
+};
+
+//Return the glyph shown on the left digit for a queue value
+uint8_t segLeftGlyph(int value){
+    if(value >= SEG_STATUS_FIRST && value <= SEG_STATUS_LAST){
+        return segStatusGlyphs[value - SEG_STATUS_FIRST][0];
+    }
+    if(value >= 0 && value < 100){
+        return value / 10;
+    }
+    return GLYPH_BLANK;
+}
+
+//Return the glyph shown on the right digit for a queue value
+uint8_t segRightGlyph(int value){
+    if(value >= SEG_STATUS_FIRST && value <= SEG_STATUS_LAST){
+        return segStatusGlyphs[value - SEG_STATUS_FIRST][1];
+    }
+    if(value >= 0){
+        return value % 10;
+    }
+    return GLYPH_BLANK;
+}
+
+
+//One frame holds the finished pin values for both digits so the
+//interrupt only has to do the masked write. Each digit is one word and
+//is read whole, but sourceUs takes two loads on the M0+, so it is
+//guarded by the frame's sequence counter like the sensor snapshot.
+typedef struct {
+    volatile uint32_t seq;  //odd while the frame is being written
+    uint32_t digits[2];
+    uint64_t sourceUs;      //time of the reading shown, 0 if none
+} SegFrame;
+
+//Double buffered frames. The interrupt only reads segFrames[segFrontFrame],
+//writers fill the other frame and then swap the index.
+static SegFrame segFrames[2];
+static volatile uint8_t segFrontFrame;
+static HrTimer segScanTimer;
+static SegShownCallback segShown;
+
+//Periodic timer callback that lights the next digit of the front
+//frame, and reports the first time a new reading is lit
+static bool segScanCallback(void *arg){
+    static uint8_t digit;
+    static uint64_t shownUs;
+    const SegFrame *frame = &segFrames[segFrontFrame];
+    uint32_t seq;
+    uint64_t sourceUs;
+
+    halGpioPutMasked(SEG_WRITE_MASK, frame->digits[digit]);
+    digit ^= 1;
+
+    //Two quick swaps can have a writer filling this frame again. The
+    //writer may be a task this interrupt has stopped, so a torn read
+    //is not retried here, the next scan picks the time up instead.
+    seq = frame->seq;
+    halDmb();
+    sourceUs = frame->sourceUs;
+    halDmb();
+    if((seq & 1) || seq != frame->seq){
+        return true;
+    }
+
+    if(sourceUs != shownUs){
+        shownUs = sourceUs;
+        if(shownUs != 0 && segShown != NULL){
+            segShown(shownUs);
+        }
+    }
+
+    return true;
+}
+
+//Fill the back frame and swap it in with a single store. The scan
+//interrupt lights whichever frame is in front; the sequence counter
+//covers it still reading a frame that two quick swaps handed back.
+void segFrameShow(uint8_t left, uint8_t right, uint64_t sourceUs){
+    uint8_t back = segFrontFrame ^ 1;
+    SegFrame *frame = &segFrames[back];
+
+    frame->seq++;
+    halDmb();
+    frame->digits[0] = segDigitBits(SEG_DIGIT_LEFT, left);
+    frame->digits[1] = segDigitBits(SEG_DIGIT_RIGHT, right);
+    frame->sourceUs = sourceUs;
+    halDmb();
+    frame->seq++;
+    segFrontFrame = back;
+}
+
+void segFramesInit(SegShownCallback shown){
+    segShown = shown;
+    segFrames[0].digits[0] = segDigitBits(SEG_DIGIT_LEFT, GLYPH_0);
+    segFrames[0].digits[1] = segDigitBits(SEG_DIGIT_RIGHT, GLYPH_0);
+    segFrontFrame = 0;
+    halDmb();
+}
+
+//start the scan timer
+void segScanStart(){
+    hrTimerStart(&segScanTimer, 1000000 / SEG_SCAN_HZ, 1000000 / SEG_SCAN_HZ, segScanCallback, NULL);
+}
+
+//stop the scan timer and blank both digits
+void segScanStop(){
+    hrTimerCancel(&segScanTimer);
+    halGpioPutMasked(SEG_WRITE_MASK, 0);
+}
@@ -0,0 +1,81 @@
+//Two digit 7-segment display, scanned from a repeating high resolution
+//timer. Each interrupt lights the next digit of the front frame with
+//one masked write; writers fill the back frame and swap it in.
+
+#ifndef SEG_DISPLAY_H
+#define SEG_DISPLAY_H
+
+#include <stdint.h>
+
+#include "board.h"
+
+//Each glyph is stored as the set of segment pins to drive high, so a
+//digit refresh is one halGpioPutMasked() call instead of a gpio_put()
+//per segment.
+#define SEG_BIT(pin) (1u << (pin))
+
+#define SEG_A_BIT SEG_BIT(SevenSegA)
+#define SEG_B_BIT SEG_BIT(SevenSegB)
+#define SEG_C_BIT SEG_BIT(SevenSegC)
+#define SEG_D_BIT SEG_BIT(SevenSegD)
+#define SEG_E_BIT SEG_BIT(SevenSegE)
+#define SEG_F_BIT SEG_BIT(SevenSegF)
+#define SEG_G_BIT SEG_BIT(SevenSegG)
+
+//digit select bits, right digit is CC1 and left digit is CC2
+#define SEG_DIGIT_RIGHT SEG_BIT(SevenSegCC1)
+#define SEG_DIGIT_LEFT SEG_BIT(SevenSegCC2)
+
+//every pin touched by a digit refresh (decimal point is left alone)
+#define SEG_WRITE_MASK (SEG_A_BIT | SEG_B_BIT | SEG_C_BIT | SEG_D_BIT | \
+                        SEG_E_BIT | SEG_F_BIT | SEG_G_BIT |             \
+                        SEG_DIGIT_RIGHT | SEG_DIGIT_LEFT)
+
+//Glyph indexes into segGlyphMasks. Digits come first so a digit value
+//is its own glyph index.
+enum {
+    GLYPH_0, GLYPH_1, GLYPH_2, GLYPH_3, GLYPH_4,
+    GLYPH_5, GLYPH_6, GLYPH_7, GLYPH_8, GLYPH_9,
+    GLYPH_E, GLYPH_P, GLYPH_H, GLYPH_F, GLYPH_b, GLYPH_C, GLYPH_O,
+    GLYPH_r,
+    GLYPH_BLANK,
+    GLYPH_COUNT
+};
+
+extern const uint32_t segGlyphMasks[GLYPH_COUNT];
+
+//Left and right glyphs for the status codes 992-999
+#define SEG_STATUS_FIRST 992
+#define SEG_STATUS_LAST 999
+
+//The display is scanned from a repeating timer interrupt. Each
+//interrupt lights the next digit, so each digit is on for half of
+//the scan period at SEG_SCAN_HZ / 2 refreshes per second.
+#define SEG_SCAN_HZ 1000
+
+//called from the scan interrupt the first time the reading taken at
+//sourceUs is lit
+typedef void (*SegShownCallback)(uint64_t sourceUs);
+
+//Return the glyph shown on the left or right digit for a queue value
+uint8_t segLeftGlyph(int value);
+uint8_t segRightGlyph(int value);
+
+//Pin values for one digit showing glyph. digitSelect is
+//SEG_DIGIT_LEFT or SEG_DIGIT_RIGHT.
+static inline uint32_t segDigitBits(uint32_t digitSelect, uint8_t glyph){
+    return digitSelect | segGlyphMasks[glyph];
+}
+
+//Show 00 in the front frame and set the callback for readings lit
+void segFramesInit(SegShownCallback shown);
+
+//Fill the back frame with a pair of glyphs from the reading taken at
+//sourceUs (0 for none) and swap it in. Callers keep writers apart.
+void segFrameShow(uint8_t left, uint8_t right, uint64_t sourceUs);
+
+//start and stop the scan timer, on the core that owns the display pins
+void segScanStart();
+void segScanStop();
+
+#endif
@@ -0,0 +1,379 @@
+//Step engine and step timing, see step_engine.h
+
+#include <string.h>
+
+#include "hal.h"
+#include "board.h"
+#include "hrtimer.h"
+#include "step_engine.h"
+
+//Coil patterns for IN1-IN4 as pin masks so a phase change is a single
+//masked write. Stepping forward through a table turns the motor
+//clockwise.
+#define STEP_COIL_BIT(pin) (1u << (pin))
+#define STEP_COILS(in1, in2, in3, in4) \
+    (((in1) ? STEP_COIL_BIT(StepMotorIN1) : 0) | \
+     ((in2) ? STEP_COIL_BIT(StepMotorIN2) : 0) | \
+     ((in3) ? STEP_COIL_BIT(StepMotorIN3) : 0) | \
+     ((in4) ? STEP_COIL_BIT(StepMotorIN4) : 0))
+#define STEP_PIN_MASK STEP_COILS(1, 1, 1, 1)
+
+//Half step cycle: alternates one and two coils on, 8 phases. Full step
+//uses only the odd phases (two coils on) and wave drive only the even
+//ones (one coil on), so every mode steps through this one table.
+static const uint32_t stepPhases[8] = {
+    STEP_COILS(1, 0, 0, 0),
+    STEP_COILS(1, 1, 0, 0),
+    STEP_COILS(0, 1, 0, 0),
+    STEP_COILS(0, 1, 1, 0),
+    STEP_COILS(0, 0, 1, 0),
+    STEP_COILS(0, 0, 1, 1),
+    STEP_COILS(0, 0, 0, 1),
+    STEP_COILS(1, 0, 0, 1),
+};
+
+//microseconds to wait before ramp step k, index 0 is the start rate
+static uint32_t stepRampUs[STEP_RAMP_MAX];
+static uint32_t stepRampLen;
+
+//speed profile as last set, the table is built from it for each mode
+static uint32_t stepStartRate;
+static uint32_t stepMaxRate;
+static uint32_t stepAccel;
+
+//state shared with the timer callback
+static volatile bool stepRunning;
+static volatile bool stepAbort;
+static uint32_t stepTotal;
+static uint32_t stepDone;
+static int8_t stepDir;
+static bool stepToTarget;
+static int32_t stepTarget;
+static StepMode stepMode = STEP_DRIVE_MODE;
+static StepDoneCallback stepDoneCallback;
+
+//electrical position in half steps (0-7), an index into stepPhases
+static uint8_t stepPhase = 1;
+static HrTimer stepTimer;
+
+//signed absolute position in half steps, positive is clockwise
+static volatile int32_t stepPosition;
+
+//integer square root, used when building the ramp table
+static uint32_t isqrt32(uint32_t n){
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+
+    while(bit > n){
+        bit >>= 2;
+    }
+    while(bit != 0){
+        if(n >= root + bit){
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else{
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+void stepEngineInit(StepDoneCallback done){
+    stepDoneCallback = done;
+    stepMode = STEP_DRIVE_MODE;
+    stepEngineSetProfile(STEP_START_RATE, STEP_MAX_RATE, STEP_ACCEL);
+}
+
+uint32_t stepEngineRateLimit(StepMode mode){
+    return mode == STEP_MODE_HALF ? STEP_RATE_LIMIT_HALF : STEP_RATE_LIMIT_FULL;
+}
+
+//Build the ramp table for the profile in the current mode. Step k of
+//the ramp runs at sqrt(startRate^2 + 2 * accel * k) steps per second.
+static void stepBuildRamp(){
+    uint32_t startRate = stepStartRate;
+    uint32_t maxRate = stepMaxRate;
+    uint32_t accel = stepAccel;
+
+    if(maxRate > stepEngineRateLimit(stepMode)){
+        maxRate = stepEngineRateLimit(stepMode);
+    }
+    if(startRate > maxRate){
+        startRate = maxRate;
+    }
+    if(startRate == 0){
+        startRate = 1;
+    }
+    if(maxRate < startRate){
+        maxRate = startRate;
+    }
+
+    stepRampLen = 0;
+    while(stepRampLen < STEP_RAMP_MAX){
+        uint32_t rate = isqrt32(startRate * startRate + 2 * accel * stepRampLen);
+        if(rate > maxRate){
+            break;
+        }
+        stepRampUs[stepRampLen++] = 1000000 / rate;
+    }
+    if(stepRampLen == 0){
+        stepRampUs[stepRampLen++] = 1000000 / startRate;
+    }
+}
+
+//Must not be called while a move is running
+void stepEngineSetProfile(uint32_t startRate, uint32_t maxRate, uint32_t accel){
+    stepStartRate = startRate;
+    stepMaxRate = maxRate;
+    stepAccel = accel;
+    stepBuildRamp();
+}
+
+//Select the drive mode used by the following moves. Move lengths and
+//the speed profile are in steps of the selected mode. The coils are
+//left alone; if the rotor sits on a phase the new mode does not use,
+//the first step of the next move is a half step onto one that it does.
+//The ramp table is rebuilt for the rate limit of the new mode.
+//Must not be called while a move is running.
+void stepEngineSetMode(StepMode mode){
+    stepMode = mode;
+    stepBuildRamp();
+}
+
+//number of steps in the current mode that make up one full step
+int32_t stepEngineStepsPerFullStep(){
+    return stepMode == STEP_MODE_HALF ? 2 : 1;
+}
+
+int32_t stepEngineStepsTo(int32_t target){
+    int32_t delta = target - stepPosition;
+    int32_t dist = delta < 0 ? -delta : delta;
+    int32_t steps;
+
+    if(stepMode == STEP_MODE_HALF || dist == 0){
+        steps = dist;
+    }
+    //the first step is a half step when the rotor is on a phase of the
+    //other parity, and the last one when the target is, see stepAdvance()
+    else if((stepPhase & 1) != (stepMode == STEP_MODE_FULL)){
+        steps = 1 + dist / 2;
+    }
+    else{
+        steps = (dist + 1) / 2;
+    }
+    return delta < 0 ? -steps : steps;
+}
+
+uint32_t stepEngineRampLen(){
+    return stepRampLen;
+}
+
+uint32_t stepEngineRampUs(uint32_t k){
+    return stepRampUs[k];
+}
+
+//Advance the electrical position one step in dir (+1/-1) and energize
+//the coils for it, a dir of 0 re-energizes the current phase. Full and
+//wave steps are two half steps, or one when the rotor is on a phase of
+//the other parity, so the position always follows the rotor. A move
+//to a target ends with a half step if a full one would overshoot it.
+static void stepAdvance(int8_t dir){
+    int8_t delta = dir;
+
+    if(stepMode == STEP_MODE_FULL && (stepPhase & 1) == 1){
+        delta = 2 * dir;
+    }
+    else if(stepMode == STEP_MODE_WAVE && (stepPhase & 1) == 0){
+        delta = 2 * dir;
+    }
+    if(stepToTarget && (stepTarget - stepPosition) * dir < delta * dir){
+        delta = dir;
+    }
+
+    stepPhase = (stepPhase + delta) & 7;
+    stepPosition += delta;
+
+    halGpioPutMasked(STEP_PIN_MASK, stepPhases[stepPhase]);
+}
+
+void stepEngineEnergize(){
+    stepAdvance(0);
+}
+
+void stepEngineRelease(){
+    halGpioPutMasked(STEP_PIN_MASK, 0);
+}
+
+//Wait before step i of the current move. Steps speed up from both
+//ends of the move, so short moves use a triangular profile.
+static uint32_t stepIntervalUs(uint32_t i){
+    uint32_t k = i;
+
+    if(stepTotal - 1 - i < k){
+        k = stepTotal - 1 - i;
+    }
+    if(k >= stepRampLen){
+        k = stepRampLen - 1;
+    }
+    return stepRampUs[k];
+}
+
+//Timer callback, takes one step and sets the wait before the next
+//one. The timer service reschedules relative to when this call was
+//due, so the step timing does not drift with interrupt latency.
+static bool stepTimerCallback(void *arg){
+    if(!stepAbort){
+        stepAdvance(stepDir);
+        stepTimingStep(halTimeUs32(), stepTimer.periodUs);
+        stepDone++;
+    }
+
+    if(stepAbort || stepDone >= stepTotal){
+        stepRunning = false;
+        stepTimingEnd();
+        if(stepDoneCallback != NULL){
+            stepDoneCallback();
+        }
+        return false;
+    }
+
+    stepTimer.periodUs = stepIntervalUs(stepDone);
+    return true;
+}
+
+bool stepEngineLoad(int32_t steps){
+    if(steps == 0){
+        return false;
+    }
+
+    stepDir = steps > 0 ? 1 : -1;
+    stepTotal = steps > 0 ? steps : -steps;
+    stepDone = 0;
+    stepAbort = false;
+    stepToTarget = false;
+    stepRunning = true;
+
+    return true;
+}
+
+bool stepEngineLoadTo(int32_t target){
+    if(!stepEngineLoad(stepEngineStepsTo(target))){
+        return false;
+    }
+
+    stepTarget = target;
+    stepToTarget = true;
+
+    return true;
+}
+
+bool stepEngineStart(){
+    stepTimingStart(halTimeUs32());
+    if(hrTimerStart(&stepTimer, stepIntervalUs(0), stepIntervalUs(0), stepTimerCallback, NULL)){
+        return true;
+    }
+
+    //no alarm slot was free, so no step will come to end the move. End
+    //it here, so whoever waits for the done callback is not left waiting.
+    stepRunning = false;
+    if(stepDoneCallback != NULL){
+        stepDoneCallback();
+    }
+    return false;
+}
+
+void stepEngineStop(){
+    if(stepRunning){
+        stepAbort = true;
+    }
+}
+
+bool stepEngineRunning(){
+    return stepRunning;
+}
+
+int32_t stepEnginePosition(){
+    return stepPosition;
+}
+
+//The step timer times each phase change against the interval it was
+//commanded to wait. How far off each interval was goes into a jitter
+//histogram kept since boot, and every move gets its own summary. Only
+//the step timer writes here. The finished move summary is published
+//with a sequence counter, like the sensor snapshot, so tasks on the
+//other core can read it without locking.
+static uint32_t stepLastUs;
+static uint64_t stepAbsErrSum;
+static StepMoveStats stepMoveCur;
+static StepMoveStats stepMoveLast;
+static volatile uint32_t stepMoveSeq;
+static LatencyHist stepJitterHist;
+static volatile uint32_t stepLateTotal;
+
+//a move is starting, nowUs is when its first interval begins
+void stepTimingStart(uint32_t nowUs){
+    stepLastUs = nowUs;
+    stepAbsErrSum = 0;
+    memset(&stepMoveCur, 0, sizeof(stepMoveCur));
+    stepMoveCur.minErrUs = INT32_MAX;
+    stepMoveCur.maxErrUs = INT32_MIN;
+}
+
+//a step was taken at nowUs after waiting an interval of commandedUs
+void stepTimingStep(uint32_t nowUs, uint32_t commandedUs){
+    int32_t err = nowUs - stepLastUs - commandedUs;
+    uint32_t absErr = err < 0 ? -err : err;
+
+    stepLastUs = nowUs;
+    histAdd(&stepJitterHist, absErr);
+    stepAbsErrSum += absErr;
+
+    stepMoveCur.steps++;
+    if(err < stepMoveCur.minErrUs){
+        stepMoveCur.minErrUs = err;
+    }
+    if(err > stepMoveCur.maxErrUs){
+        stepMoveCur.maxErrUs = err;
+    }
+    if(err > 0 && (uint64_t)err * 100 > (uint64_t)commandedUs * STEP_LATE_PCT){
+        stepMoveCur.late++;
+        stepLateTotal++;
+    }
+}
+
+//the move is finished or stopped, publish its summary
+void stepTimingEnd(){
+    if(stepMoveCur.steps != 0){
+        stepMoveCur.meanAbsErrUs = stepAbsErrSum / stepMoveCur.steps;
+    }
+
+    stepMoveSeq++;
+    halDmb();
+    stepMoveLast = stepMoveCur;
+    halDmb();
+    stepMoveSeq++;
+}
+
+//Copy the summary of the last finished move. Returns false if no move
+//has finished yet.
+bool stepTimingLastMove(StepMoveStats *stats){
+    uint32_t seq;
+
+    do{
+        seq = stepMoveSeq;
+        halDmb();
+        *stats = stepMoveLast;
+        halDmb();
+    } while((seq & 1) || seq != stepMoveSeq);
+
+    return seq != 0;
+}
+
+//Copy the jitter histogram and the number of late steps since boot.
+//Counts may be one step apart if a step lands during the copy.
+void stepTimingJitter(LatencyHist *hist, uint32_t *late){
+    *hist = stepJitterHist;
+    *late = stepLateTotal;
+}
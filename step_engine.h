@@ -0,0 +1,120 @@
+//Step engine for the 28BYJ-48 on its ULN2003 driver. Phase changes are
+//made from a high resolution timer so the step rate is independent of
+//the RTOS tick. Each move follows a trapezoidal speed profile: it starts
+//at STEP_START_RATE, accelerates at STEP_ACCEL up to STEP_MAX_RATE and
+//decelerates symmetrically so the last step is back at the start rate.
+//
+//A move is set up with stepEngineLoad() and run by stepEngineStart() on
+//the core that owns the motor pins. The done callback runs from the
+//timer interrupt when it ends, or from stepEngineStart() if the timer
+//cannot be started.
+
+#ifndef STEP_ENGINE_H
+#define STEP_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "latency_hist.h"
+
+//Step motor drive modes
+typedef enum {
+    STEP_MODE_WAVE,     //one coil on, lowest current and torque
+    STEP_MODE_FULL,     //two coils on, full torque
+    STEP_MODE_HALF      //alternates one and two coils, twice the resolution
+} StepMode;
+
+//drive mode at start, Assign9.c picks one per move with MOTION_SET_MODE
+#define STEP_DRIVE_MODE STEP_MODE_FULL
+
+//Step engine speed profile, in steps per second (and steps per second^2)
+#define STEP_START_RATE 200
+#define STEP_MAX_RATE 600
+#define STEP_ACCEL 2000
+
+//largest number of ramp steps kept in the interval table
+#define STEP_RAMP_MAX 256
+
+//Highest maximum rate each drive mode runs at, whatever the profile
+//asks for. A full or wave step turns the rotor two half steps, and on
+//the motor model (test_motor) they lose steps above 622 steps/s. Half
+//steps stay clean up to the fastest rate the ramp table reaches.
+#define STEP_RATE_LIMIT_FULL 600
+#define STEP_RATE_LIMIT_HALF 1000
+
+//full steps taken by one call to rotateCW() or rotateCCW()
+#define STEPS_PER_ROTATE 4
+
+//A step interval more than STEP_LATE_PCT percent longer than commanded
+//counts as a missed deadline
+#define STEP_LATE_PCT 10
+
+//called from the step timer when a move has ended
+typedef void (*StepDoneCallback)();
+
+//step timing of one move, errors are actual minus commanded interval
+typedef struct {
+    uint32_t steps;
+    uint32_t late;              //intervals over STEP_LATE_PCT late
+    int32_t minErrUs;           //earliest step, negative is early
+    int32_t maxErrUs;           //latest step
+    uint32_t meanAbsErrUs;
+} StepMoveStats;
+
+//Build the default speed profile and set the callback for the end of
+//a move
+void stepEngineInit(StepDoneCallback done);
+
+//Set the speed profile. maxRate is held to the limit of the drive
+//mode, now and after each mode change.
+void stepEngineSetProfile(uint32_t startRate, uint32_t maxRate, uint32_t accel);
+void stepEngineSetMode(StepMode mode);
+int32_t stepEngineStepsPerFullStep();
+
+//highest maximum rate of a drive mode, in its steps per second
+uint32_t stepEngineRateLimit(StepMode mode);
+
+//Steps of the current mode from the current position to target, in
+//half steps. Full and wave moves to a target they cannot land on end
+//with a half step, which is counted. Must not be called while a move
+//is running.
+int32_t stepEngineStepsTo(int32_t target);
+
+//ramp table, wait before ramp step k for k below stepEngineRampLen()
+uint32_t stepEngineRampLen();
+uint32_t stepEngineRampUs(uint32_t k);
+
+//Set up a move of steps (positive is clockwise) and mark the engine
+//running. Returns false and does nothing for a move of 0 steps.
+bool stepEngineLoad(int32_t steps);
+
+//Set up a move to the absolute position target, in half steps, landing
+//on it in every mode. Returns false and does nothing if already there.
+bool stepEngineLoadTo(int32_t target);
+
+//Start the step timer for the loaded move, on the core owning the
+//pins. Returns false if no timer alarm was free; the move is then over
+//without a step, and the done callback has been called from here.
+bool stepEngineStart();
+
+//Stop a running move at the next step, without deceleration
+void stepEngineStop();
+
+//true from stepEngineLoad() until the move has ended
+bool stepEngineRunning();
+
+//signed absolute position in half steps, positive is clockwise
+int32_t stepEnginePosition();
+
+//energize the coils for the current phase, or de-energize all of them
+void stepEngineEnergize();
+void stepEngineRelease();
+
+//step timing, recorded by the step timer
+void stepTimingStart(uint32_t nowUs);
+void stepTimingStep(uint32_t nowUs, uint32_t commandedUs);
+void stepTimingEnd();
+bool stepTimingLastMove(StepMoveStats *stats);
+void stepTimingJitter(LatencyHist *hist, uint32_t *late);
+
+#endif
@@ -0,0 +1,227 @@
+//Binary task snapshot and trace frames, see task_stream.h
+
+#include <string.h>
+
+#include "task_stream.h"
+
+_Static_assert(sizeof(TraceEvent) == 8, "TraceEvent must have no padding");
+
+//What a reader needs to know about one kind of frame: its magic, and
+//checks of the payload length, made as soon as the length is read so a
+//false magic in text is passed over at once, and of the payload, made
+//once the checksum agrees
+typedef struct {
+    const char *magic;
+    bool (*lengthOk)(size_t payload);
+    bool (*payloadOk)(const uint8_t *payload, size_t len);
+} TaskStreamType;
+
+uint16_t taskStreamChecksumAdd(uint16_t sum, const uint8_t *data, size_t len){
+    uint16_t sum1 = sum & 0xFF;
+    uint16_t sum2 = sum >> 8;
+
+    for(size_t i = 0; i < len; i++){
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return sum2 << 8 | sum1;
+}
+
+uint16_t taskStreamChecksum(const uint8_t *data, size_t len){
+    return taskStreamChecksumAdd(0, data, len);
+}
+
+size_t taskStreamEncode(uint8_t *frame, size_t max, const TaskRecord *records, uint8_t count){
+    size_t payload = 1 + count * sizeof(TaskRecord);
+    size_t len = TASK_STREAM_OVERHEAD - 1 + payload;
+    uint16_t sum;
+
+    if(count > TASK_STREAM_MAX_TASKS || len > max){
+        return 0;
+    }
+
+    memcpy(frame, TASK_STREAM_MAGIC, TASK_STREAM_MAGIC_LEN);
+    frame[4] = payload & 0xFF;
+    frame[5] = payload >> 8;
+    frame[6] = count;
+    memcpy(&frame[7], records, count * sizeof(TaskRecord));
+
+    sum = taskStreamChecksum(&frame[4], 2 + payload);
+    frame[len - 2] = sum & 0xFF;
+    frame[len - 1] = sum >> 8;
+
+    return len;
+}
+
+//Check the frame starting at buf, which begins with the magic of type.
+//Returns its length if it is valid, 0 if it is not, or -1 if it runs
+//past len.
+static long taskStreamCheck(const TaskStreamType *type, const uint8_t *buf, size_t len){
+    size_t payload;
+    size_t frameLen;
+    uint16_t sum;
+
+    if(len < TASK_STREAM_MAGIC_LEN + 2){
+        return -1;
+    }
+    payload = buf[4] | buf[5] << 8;
+    if(payload < 1 || !type->lengthOk(payload)){
+        return 0;
+    }
+
+    frameLen = TASK_STREAM_OVERHEAD - 1 + payload;
+    if(len < frameLen){
+        return -1;
+    }
+
+    sum = taskStreamChecksum(&buf[4], 2 + payload);
+    if(buf[frameLen - 2] != (sum & 0xFF) || buf[frameLen - 1] != sum >> 8){
+        return 0;
+    }
+    if(!type->payloadOk(&buf[6], payload)){
+        return 0;
+    }
+    return frameLen;
+}
+
+//Find the first whole, valid frame of type in buf. Returns its length
+//and sets *start to its offset, or returns 0. *keep is set as for
+//taskStreamDecode().
+static size_t taskStreamFind(const TaskStreamType *type, const uint8_t *buf, size_t len, size_t *start, size_t *keep){
+    *keep = len;
+
+    for(size_t i = 0; i + TASK_STREAM_MAGIC_LEN <= len; i++){
+        long frameLen;
+
+        if(memcmp(&buf[i], type->magic, TASK_STREAM_MAGIC_LEN) != 0){
+            continue;
+        }
+
+        frameLen = taskStreamCheck(type, &buf[i], len - i);
+        if(frameLen < 0){
+            //may still complete, keep it for the next call
+            if(*keep == len){
+                *keep = i;
+            }
+            continue;
+        }
+        if(frameLen > 0){
+            *start = i;
+            *keep = i + frameLen;
+            return frameLen;
+        }
+    }
+
+    //a magic cut off at the end may be the start of the next frame
+    if(*keep == len){
+        size_t tail = len < TASK_STREAM_MAGIC_LEN - 1 ? len : TASK_STREAM_MAGIC_LEN - 1;
+
+        for(size_t t = tail; t > 0; t--){
+            if(memcmp(&buf[len - t], type->magic, t) == 0){
+                *keep = len - t;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+//a count byte and whole records, no more than TASK_STREAM_MAX_TASKS
+static bool taskSnapshotLengthOk(size_t payload){
+    return (payload - 1) % sizeof(TaskRecord) == 0 &&
+           (payload - 1) / sizeof(TaskRecord) <= TASK_STREAM_MAX_TASKS;
+}
+
+static bool taskSnapshotPayloadOk(const uint8_t *payload, size_t len){
+    return payload[0] == (len - 1) / sizeof(TaskRecord);
+}
+
+static const TaskStreamType taskSnapshotType = {
+    TASK_STREAM_MAGIC, taskSnapshotLengthOk, taskSnapshotPayloadOk
+};
+
+size_t taskStreamDecode(const uint8_t *buf, size_t len, TaskFrame *frame, size_t *keep){
+    size_t start;
+    size_t frameLen = taskStreamFind(&taskSnapshotType, buf, len, &start, keep);
+
+    if(frameLen == 0){
+        return 0;
+    }
+
+    frame->count = buf[start + 6];
+    memcpy(frame->records, &buf[start + 7], frame->count * sizeof(TaskRecord));
+    return start + frameLen;
+}
+
+//payload length of a trace frame
+static size_t taskTracePayload(size_t names, size_t events){
+    return 1 + names * sizeof(TraceName) + events * sizeof(TraceEvent);
+}
+
+static bool taskTraceLengthOk(size_t payload){
+    return payload <= taskTracePayload(TASK_TRACE_MAX_NAMES, TASK_TRACE_MAX_EVENTS);
+}
+
+//the names fit and the events fill the rest exactly
+static bool taskTracePayloadOk(const uint8_t *payload, size_t len){
+    size_t names = payload[0];
+    size_t events;
+
+    if(names > TASK_TRACE_MAX_NAMES || taskTracePayload(names, 0) > len){
+        return false;
+    }
+    events = len - taskTracePayload(names, 0);
+    return events % sizeof(TraceEvent) == 0 && events / sizeof(TraceEvent) <= TASK_TRACE_MAX_EVENTS;
+}
+
+static const TaskStreamType taskTraceType = {
+    TASK_TRACE_MAGIC, taskTraceLengthOk, taskTracePayloadOk
+};
+
+bool taskTraceWrite(TaskStreamPut put, const TraceName *names, uint8_t nameCount,
+                    const TraceEvent *first, uint16_t firstCount,
+                    const TraceEvent *second, uint16_t secondCount){
+    size_t payload = taskTracePayload(nameCount, (size_t)firstCount + secondCount);
+    uint8_t head[3] = {payload & 0xFF, payload >> 8, nameCount};
+    uint8_t tail[2];
+    uint16_t sum;
+
+    if(nameCount > TASK_TRACE_MAX_NAMES || (size_t)firstCount + secondCount > TASK_TRACE_MAX_EVENTS){
+        return false;
+    }
+
+    sum = taskStreamChecksum(head, sizeof(head));
+    sum = taskStreamChecksumAdd(sum, (const uint8_t *)names, nameCount * sizeof(TraceName));
+    sum = taskStreamChecksumAdd(sum, (const uint8_t *)first, firstCount * sizeof(TraceEvent));
+    sum = taskStreamChecksumAdd(sum, (const uint8_t *)second, secondCount * sizeof(TraceEvent));
+    tail[0] = sum & 0xFF;
+    tail[1] = sum >> 8;
+
+    put((const uint8_t *)TASK_TRACE_MAGIC, TASK_STREAM_MAGIC_LEN);
+    put(head, sizeof(head));
+    put((const uint8_t *)names, nameCount * sizeof(TraceName));
+    put((const uint8_t *)first, firstCount * sizeof(TraceEvent));
+    put((const uint8_t *)second, secondCount * sizeof(TraceEvent));
+    put(tail, sizeof(tail));
+
+    return true;
+}
+
+size_t taskTraceDecode(const uint8_t *buf, size_t len, TraceFrame *frame, size_t *keep){
+    size_t start;
+    size_t frameLen = taskStreamFind(&taskTraceType, buf, len, &start, keep);
+    const uint8_t *payload;
+    size_t namesLen;
+
+    if(frameLen == 0){
+        return 0;
+    }
+
+    payload = &buf[start + 6];
+    frame->nameCount = payload[0];
+    namesLen = frame->nameCount * sizeof(TraceName);
+    memcpy(frame->names, &payload[1], namesLen);
+    frame->eventCount = (frameLen - TASK_STREAM_OVERHEAD - namesLen) / sizeof(TraceEvent);
+    memcpy(frame->events, &payload[1 + namesLen], frame->eventCount * sizeof(TraceEvent));
+    return start + frameLen;
+}
@@ -0,0 +1,132 @@
+//Binary task snapshot and trace frames, written to the console by the
+//firmware and read back on the host by tools/taskdump and
+//tools/tracedump. Kept free of FreeRTOS so both sides share one
+//definition of the format.
+//
+//A frame is, little endian and packed:
+//
+//  magic       "TSK2" for a task snapshot, "TRC1" for a trace
+//  uint16      length of the payload
+//  payload
+//  uint16      Fletcher-16 of the length and payload
+//
+//A task snapshot payload is
+//
+//  uint8       count
+//  TaskRecord  count records
+//
+//and a trace payload
+//
+//  uint8       name count
+//  TraceName   names of the tasks and queues the events refer to
+//  TraceEvent  events, oldest first, to the end of the payload
+//
+//The stream may carry console text between frames. A reader scans for
+//the magic and takes a frame only if its length and checksum agree,
+//so text that happens to contain the magic is skipped.
+
+#ifndef TASK_STREAM_H
+#define TASK_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TASK_STREAM_MAGIC "TSK2"
+#define TASK_STREAM_MAGIC_LEN 4
+
+//name bytes kept per task, configMAX_TASK_NAME_LEN on the firmware side
+#define TASK_STREAM_NAME_LEN 16
+
+//most records in one frame
+#define TASK_STREAM_MAX_TASKS 32
+
+//One task, little endian and packed
+typedef struct __attribute__((packed)) {
+    uint8_t number;
+    uint8_t state;              //eTaskState
+    uint8_t priority;
+    uint8_t basePriority;
+    uint16_t stackFree;         //fewest free stack words ever
+    uint32_t runTimeUs;
+    char name[TASK_STREAM_NAME_LEN];
+} TaskRecord;
+
+//magic, length, count and checksum around the records
+#define TASK_STREAM_OVERHEAD (TASK_STREAM_MAGIC_LEN + 2 + 1 + 2)
+#define TASK_STREAM_FRAME_MAX (TASK_STREAM_OVERHEAD + TASK_STREAM_MAX_TASKS * sizeof(TaskRecord))
+
+typedef struct {
+    uint8_t count;
+    TaskRecord records[TASK_STREAM_MAX_TASKS];
+} TaskFrame;
+
+#define TASK_TRACE_MAGIC "TRC1"
+
+//most names and events in one trace frame
+#define TASK_TRACE_MAX_NAMES 32
+#define TASK_TRACE_MAX_EVENTS 4096
+
+//One recorded kernel event, 8 bytes with no padding so the recorder
+//stores it with aligned writes
+typedef struct {
+    uint32_t timeUs;
+    uint8_t event;              //TRACE_ code from FreeRTOSConfig.h
+    uint8_t task;               //task number running when it happened
+    uint16_t object;            //task or queue number, or notify index
+} TraceEvent;
+
+//what a TraceName names
+#define TRACE_NAME_TASK 0
+#define TRACE_NAME_QUEUE 1
+
+//Name of a task or queue number
+typedef struct {
+    uint8_t kind;               //TRACE_NAME_TASK or TRACE_NAME_QUEUE
+    uint8_t number;
+    char name[TASK_STREAM_NAME_LEN];
+} TraceName;
+
+#define TASK_TRACE_FRAME_MAX (TASK_STREAM_OVERHEAD + TASK_TRACE_MAX_NAMES * sizeof(TraceName) + \
+                              TASK_TRACE_MAX_EVENTS * sizeof(TraceEvent))
+
+typedef struct {
+    uint8_t nameCount;
+    TraceName names[TASK_TRACE_MAX_NAMES];
+    uint16_t eventCount;
+    TraceEvent events[TASK_TRACE_MAX_EVENTS];
+} TraceFrame;
+
+//Fletcher-16 of len bytes
+uint16_t taskStreamChecksum(const uint8_t *data, size_t len);
+
+//Fletcher-16 of len more bytes, carrying on from the sum of the bytes
+//before them
+uint16_t taskStreamChecksumAdd(uint16_t sum, const uint8_t *data, size_t len);
+
+//Writes the next len bytes of a frame
+typedef void (*TaskStreamPut)(const uint8_t *data, size_t len);
+
+//Write a frame of count records into frame. Returns its length, or 0
+//if count is over TASK_STREAM_MAX_TASKS or it does not fit in max.
+size_t taskStreamEncode(uint8_t *frame, size_t max, const TaskRecord *records, uint8_t count);
+
+//Find the first whole, valid frame in buf and decode it into frame.
+//Returns the offset just past it, or 0 if buf holds none. Either way
+//the bytes before *keep are done with; a frame cut off at the end of
+//buf starts at *keep and is completed by the bytes read next.
+size_t taskStreamDecode(const uint8_t *buf, size_t len, TaskFrame *frame, size_t *keep);
+
+//Write a trace frame through put, a piece at a time so nothing is
+//copied. The events are given as two runs, first then second, so a
+//ring that has wrapped goes out as it is. Returns false and writes
+//nothing if there are too many names or events.
+bool taskTraceWrite(TaskStreamPut put, const TraceName *names, uint8_t nameCount,
+                    const TraceEvent *first, uint16_t firstCount,
+                    const TraceEvent *second, uint16_t secondCount);
+
+//Find and decode the first trace frame in buf, as taskStreamDecode()
+//does for task snapshots
+size_t taskTraceDecode(const uint8_t *buf, size_t len, TraceFrame *frame, size_t *keep);
+
+#endif
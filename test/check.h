@@ -0,0 +1,29 @@
+//Minimal checks for the host tests. A failed CHECK prints where and
+//what, and the test returns checkResult() from main so ctest sees it.
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int checkFailures;
+
+#define CHECK(cond)                                                     \
+    do{                                                                 \
+        if(!(cond)){                                                    \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            checkFailures++;                                            \
+        }                                                               \
+    } while(0)
+
+//exit status for main, 0 when every check passed
+static inline int checkResult(){
+    if(checkFailures != 0){
+        printf("%d checks failed\n", checkFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
+
+#endif
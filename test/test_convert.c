@@ -0,0 +1,124 @@
+//HDC1080 integer conversions checked against the datasheet formulas in
+//double for every one of the 65536 raw codes, then timed against the
+//floating point path they replaced. The timing is of the host, where
+//floating point is in hardware, so the gain it shows is a lower bound
+//for the M0+, which calls the soft-float library.
+
+#include <stdio.h>
+#include <time.h>
+
+#include "hal.h"
+#include "hdc1080.h"
+#include "check.h"
+
+#define BENCH_PASSES 200
+
+//datasheet formulas in hundredths, unrounded
+static double refTempC100(uint16_t raw){
+    return (raw / 65536.0 * 165 - 40) * 100;
+}
+
+static double refTempF100(uint16_t raw){
+    return ((raw / 65536.0 * 165 - 40) * 1.8 + 32) * 100;
+}
+
+static double refHumidity100(uint16_t raw){
+    return raw / 65536.0 * 100 * 100;
+}
+
+//distance of a conversion from the exact value, in hundredths
+static double errorOf(int value, double ref){
+    double err = value - ref;
+
+    return err < 0 ? -err : err;
+}
+
+static double maxOf(double a, double b){
+    return a > b ? a : b;
+}
+
+//The integer conversions must round to the nearest hundredth, so be
+//within half of one of the exact value. Fahrenheit from the raw code
+//keeps that; the old path through whole degrees C did not.
+static void testExhaustive(){
+    double errC = 0;
+    double errF = 0;
+    double errH = 0;
+    double errOldF = 0;
+
+    for(uint32_t raw = 0; raw <= 0xFFFF; raw++){
+        int wholeC = centiRound(hdc1080TempC100(raw));
+
+        errC = maxOf(errC, errorOf(hdc1080TempC100(raw), refTempC100(raw)));
+        errF = maxOf(errF, errorOf(hdc1080TempF100(raw), refTempF100(raw)));
+        errH = maxOf(errH, errorOf(hdc1080Humidity100(raw), refHumidity100(raw)));
+        errOldF = maxOf(errOldF, errorOf(wholeC * 180 + 3200, refTempF100(raw)));
+    }
+
+    printf("max error in hundredths: C %.3f, F %.3f, RH %.3f, F via whole C %.3f\n",
+           errC, errF, errH, errOldF);
+    CHECK(errC <= 0.5 + 1e-6);
+    CHECK(errF <= 0.5 + 1e-6);
+    CHECK(errH <= 0.5 + 1e-6);
+    CHECK(errOldF > 50);
+
+    //the ends of the range
+    CHECK(hdc1080TempC100(0) == -4000);
+    CHECK(hdc1080TempF100(0) == -4000);
+    CHECK(hdc1080Humidity100(0) == 0);
+    CHECK(hdc1080TempC100(0xFFFF) == 12500);
+    CHECK(hdc1080Humidity100(0xFFFF) == 10000);
+}
+
+static double nowNs(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//the double path the integer conversions replaced, rounded to hundredths
+static int floatTempC100(uint16_t raw){
+    double c = (raw / 65536.0) * 165 - 40;
+
+    return (int)(c * 100 + (c < 0 ? -0.5 : 0.5));
+}
+
+static int floatHumidity100(uint16_t raw){
+    return (int)((raw / 65536.0) * 10000 + 0.5);
+}
+
+static void benchmark(){
+    volatile int sink = 0;
+    double start;
+    double intNs;
+    double floatNs;
+    uint32_t conversions = BENCH_PASSES * 65536 * 2;
+
+    start = nowNs();
+    for(int pass = 0; pass < BENCH_PASSES; pass++){
+        for(uint32_t raw = 0; raw <= 0xFFFF; raw++){
+            sink += hdc1080TempC100(raw) + hdc1080Humidity100(raw);
+        }
+    }
+    intNs = nowNs() - start;
+
+    start = nowNs();
+    for(int pass = 0; pass < BENCH_PASSES; pass++){
+        for(uint32_t raw = 0; raw <= 0xFFFF; raw++){
+            sink += floatTempC100(raw) + floatHumidity100(raw);
+        }
+    }
+    floatNs = nowNs() - start;
+
+    printf("integer %.2f ns, double %.2f ns per conversion (host)\n",
+           intNs / conversions, floatNs / conversions);
+    (void)sink;
+}
+
+int main(){
+    testExhaustive();
+    benchmark();
+
+    return checkResult();
+}
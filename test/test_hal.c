@@ -0,0 +1,251 @@
+//Host backend of the hardware layer: the virtual clock, alarms, pin
+//writes, input interrupts and console input, then a step engine move
+//run on them
+
+#include <string.h>
+#include <unistd.h>
+
+#include "hal.h"
+#include "board.h"
+#include "hrtimer.h"
+#include "step_engine.h"
+#include "check.h"
+
+static uint64_t alarmTimes[8];
+static int alarmRuns;
+
+//one shot alarm, notes when it ran
+static int64_t oneShot(int32_t id, void *arg){
+    alarmTimes[alarmRuns++ & 7] = halTimeUs64();
+    return 0;
+}
+
+//runs three times, rescheduled relative to when it was due
+static int64_t periodic(int32_t id, void *arg){
+    alarmTimes[alarmRuns++ & 7] = halTimeUs64();
+    return alarmRuns < 3 ? -100 : 0;
+}
+
+static void testAlarms(){
+    HalAlarm a, b;
+    uint64_t start = halTimeUs64();
+
+    alarmRuns = 0;
+    CHECK(halAlarmStart(&a, 300, oneShot, NULL));
+    CHECK(halAlarmStart(&b, 100, oneShot, NULL));
+    CHECK(a.id > 0 && b.id > 0 && a.id != b.id);
+    CHECK(halHostAlarmsPending() == 2);
+
+    //both run, in due order and at their due times
+    halHostAdvanceUs(1000);
+    CHECK(alarmRuns == 2);
+    CHECK(alarmTimes[0] == start + 100);
+    CHECK(alarmTimes[1] == start + 300);
+    CHECK(halTimeUs64() == start + 1000);
+    CHECK(halHostAlarmsPending() == 0);
+
+    //a cancelled alarm never runs
+    alarmRuns = 0;
+    CHECK(halAlarmStart(&a, 10, oneShot, NULL));
+    halAlarmCancel(&a);
+    CHECK(a.id == 0);
+    halHostAdvanceUs(100);
+    CHECK(alarmRuns == 0);
+
+    //a periodic alarm does not drift when the clock jumps past it
+    alarmRuns = 0;
+    start = halTimeUs64();
+    CHECK(halAlarmStart(&a, 50, periodic, NULL));
+    halHostAdvanceUs(1000);
+    CHECK(alarmRuns == 3);
+    CHECK(alarmTimes[0] == start + 50);
+    CHECK(alarmTimes[1] == start + 150);
+    CHECK(alarmTimes[2] == start + 250);
+
+    //every slot taken
+    for(int i = 0; i < 8; i++){
+        CHECK(halAlarmStart(&a, 10, oneShot, NULL));
+    }
+    CHECK(!halAlarmStart(&b, 10, oneShot, NULL));
+    halHostAdvanceUs(10);
+}
+
+static uint32_t fixedLatency(void *ctx, uint64_t dueUs){
+    return 7;
+}
+
+//late alarms still repeat from when they were due
+static void testAlarmLatency(){
+    HalAlarm a;
+    uint64_t start = halTimeUs64();
+
+    alarmRuns = 0;
+    halHostSetAlarmLatency(fixedLatency, NULL);
+    CHECK(halAlarmStart(&a, 50, periodic, NULL));
+    halHostAdvanceUs(1000);
+    halHostSetAlarmLatency(NULL, NULL);
+    CHECK(alarmRuns == 3);
+    CHECK(alarmTimes[0] == start + 57);
+    CHECK(alarmTimes[1] == start + 157);
+    CHECK(alarmTimes[2] == start + 257);
+}
+
+static int timerRuns;
+
+static bool timerTick(void *arg){
+    return ++timerRuns < 4;
+}
+
+static void testHrTimer(){
+    HrTimer timer;
+
+    timerRuns = 0;
+    CHECK(hrTimerStart(&timer, 10, 20, timerTick, NULL));
+    halHostAdvanceUs(1000);
+    CHECK(timerRuns == 4);
+    CHECK(timer.alarm.id == 0);
+
+    //cancelled part way
+    timerRuns = 0;
+    CHECK(hrTimerStart(&timer, 10, 20, timerTick, NULL));
+    halHostAdvanceUs(35);
+    hrTimerCancel(&timer);
+    halHostAdvanceUs(1000);
+    CHECK(timerRuns == 2);
+}
+
+static unsigned irqGpio;
+static int irqRuns;
+
+static void buttonEdge(unsigned gpio){
+    irqGpio = gpio;
+    irqRuns++;
+}
+
+static void testGpio(){
+    HalPinWrite log[4];
+    uint64_t now = halTimeUs64();
+
+    //only level changes raise the interrupt
+    halGpioIrqEnable(ButtonS2, buttonEdge);
+    halHostSetInput(ButtonS2, true);
+    halHostSetInput(ButtonS2, true);
+    halHostSetInput(ButtonS2, false);
+    CHECK(irqRuns == 2);
+    CHECK(irqGpio == ButtonS2);
+    CHECK(!halGpioGet(ButtonS2));
+
+    //masked writes only change the masked pins and are logged
+    halHostPinLogClear();
+    halGpioPutMasked(0x0f, 0x05);
+    halHostAdvanceUs(7);
+    halGpioPutMasked(0x03, 0x02);
+    CHECK((halHostPins() & 0x0f) == 0x06);
+    CHECK(halHostPinLog(log, 4) == 2);
+    CHECK(log[0].timeUs == now && log[0].mask == 0x0f && log[0].value == 0x05);
+    CHECK(log[1].timeUs == now + 7 && log[1].mask == 0x03);
+}
+
+static int watchRuns[2];
+
+static void pinWatcher(void *ctx, const HalPinWrite *write){
+    (*(int *)ctx)++;
+}
+
+static void testWatchers(){
+    //a watcher removed from in front of another leaves it called
+    CHECK(halHostWatchPins(pinWatcher, &watchRuns[0]));
+    CHECK(halHostWatchPins(pinWatcher, &watchRuns[1]));
+    halGpioPutMasked(0x01, 0x01);
+    halHostUnwatchPins(pinWatcher, &watchRuns[0]);
+    halGpioPutMasked(0x01, 0x00);
+    CHECK(watchRuns[0] == 1 && watchRuns[1] == 2);
+    halHostUnwatchPins(pinWatcher, &watchRuns[1]);
+    halGpioPutMasked(0x01, 0x01);
+    CHECK(watchRuns[1] == 2);
+}
+
+static void testI2c(){
+    uint8_t b = 0;
+
+    //nothing attached answers like an empty bus
+    CHECK(halI2cWrite(0x40, &b, 1, false) == HAL_I2C_ERROR);
+    CHECK(halI2cRead(0x40, &b, 1, false) == HAL_I2C_ERROR);
+}
+
+static int consoleRxRuns;
+
+static void consoleRx(void *arg){
+    (*(int *)arg)++;
+}
+
+//The console callback runs when stdin has input and not otherwise, and
+//stops once stdin has ended. stdin is a pipe here.
+static void testConsoleRx(){
+    int fds[2];
+
+    CHECK(pipe(fds) == 0);
+    CHECK(dup2(fds[0], STDIN_FILENO) == STDIN_FILENO);
+    close(fds[0]);
+    halConsoleSetRxCallback(consoleRx, &consoleRxRuns);
+
+    halHostConsolePoll();
+    CHECK(consoleRxRuns == 0);
+    CHECK(halConsoleGetChar() == HAL_CONSOLE_NONE);
+
+    CHECK(write(fds[1], "ab", 2) == 2);
+    halHostConsolePoll();
+    CHECK(consoleRxRuns == 1);
+    CHECK(halConsoleGetChar() == 'a');
+    CHECK(halConsoleGetChar() == 'b');
+    CHECK(halConsoleGetChar() == HAL_CONSOLE_NONE);
+    halHostConsolePoll();
+    CHECK(consoleRxRuns == 1);
+
+    //the end is read once and then no longer reported
+    close(fds[1]);
+    halHostConsolePoll();
+    CHECK(consoleRxRuns == 2);
+    CHECK(halConsoleGetChar() == HAL_CONSOLE_NONE);
+    halHostConsolePoll();
+    CHECK(consoleRxRuns == 2);
+
+    halConsoleSetRxCallback(NULL, NULL);
+}
+
+static int stepDoneRuns;
+
+static void stepDone(){
+    stepDoneRuns++;
+}
+
+//a move on the step engine, as ioCoreRun() would start it
+static void testStepMove(){
+    int32_t start;
+
+    stepEngineInit(stepDone);
+    start = stepEnginePosition();
+
+    CHECK(!stepEngineLoad(0));
+    CHECK(stepEngineLoad(20));
+    CHECK(stepEngineRunning());
+    stepEngineStart();
+    halHostAdvanceUs(1000000);
+
+    CHECK(!stepEngineRunning());
+    CHECK(stepDoneRuns == 1);
+    CHECK(stepEnginePosition() - start == 20 * (2 / stepEngineStepsPerFullStep()));
+}
+
+int main(){
+    testAlarms();
+    testAlarmLatency();
+    testHrTimer();
+    testGpio();
+    testWatchers();
+    testI2c();
+    testConsoleRx();
+    testStepMove();
+
+    return checkResult();
+}
@@ -0,0 +1,217 @@
+//HDC1080 driver run against the sensor model: identity, resolution and
+//quantization, conversion timing, and each injected fault
+
+#include <stdlib.h>
+
+#include "hal.h"
+#include "hdc1080.h"
+#include "hdc1080_sim.h"
+#include "check.h"
+
+static HDC1080Sim sim;
+
+//environment the waveform reports, in hundredths
+static int32_t envTempC100;
+static int32_t envHum100;
+
+static void envWaveform(void *ctx, uint64_t timeUs, int32_t *tempC100, int32_t *humidity100){
+    *tempC100 = envTempC100;
+    *humidity100 = envHum100;
+}
+
+//a fresh model on the bus, nothing converted yet
+static void simReset(){
+    hdc1080SimAttach(&sim, HDC1080ADDRESS);
+    hdc1080SimSetWaveform(&sim, envWaveform, NULL);
+    envTempC100 = 2345;
+    envHum100 = 6789;
+}
+
+static void testProbe(){
+    HDC1080Device dev;
+    HDC1080Device found;
+
+    //nothing to report before a probe has found the sensor
+    CHECK(!hdc1080Identity(&found));
+
+    simReset();
+    CHECK(hdc1080Probe(&dev) == 0);
+    CHECK(dev.mfID == HDC1080_MFID);
+    CHECK(dev.deviceID == HDC1080_DEVID);
+    CHECK(dev.serial[0] == 0x0123 && dev.serial[1] == 0x4567 && dev.serial[2] == 0x8900);
+    CHECK(dev.config == HDC1080_MODE_ACQ);
+
+    //a bit flipped on the ID read is caught
+    hdc1080SimCorruptNext(&sim, 0x01);
+    CHECK(hdc1080Probe(&dev) == HDC1080_ERROR_ID);
+
+    //and leaves the identity of the sensor that was found
+    CHECK(hdc1080Identity(&found));
+    CHECK(found.mfID == HDC1080_MFID && found.deviceID == HDC1080_DEVID);
+    CHECK(found.serial[0] == 0x0123 && found.serial[1] == 0x4567 && found.serial[2] == 0x8900);
+}
+
+static void testNoConversion(){
+    uint8_t acq[4];
+
+    //the pointer is at the temperature register after power-on, but
+    //nothing was triggered so there is nothing to read
+    simReset();
+    CHECK(halI2cRead(HDC1080ADDRESS, acq, 4, false) == HAL_I2C_ERROR);
+    CHECK(sim.stats.nacks == 1);
+    CHECK(sim.stats.conversions == 0);
+}
+
+static void testNackUntilReady(){
+    uint8_t reg = HDC1080TEMPREG;
+    uint8_t acq[4];
+
+    simReset();
+    CHECK(hdc1080SetResolution(14, 14) >= 0);
+    CHECK(halI2cWrite(HDC1080ADDRESS, &reg, 1, false) == 1);
+    CHECK(halI2cRead(HDC1080ADDRESS, acq, 4, false) == HAL_I2C_ERROR);
+    halHostAdvanceUs(HDC1080_TEMP14_US + HDC1080_HUM14_US - 1);
+    CHECK(halI2cRead(HDC1080ADDRESS, acq, 4, false) == HAL_I2C_ERROR);
+    halHostAdvanceUs(1);
+    CHECK(halI2cRead(HDC1080ADDRESS, acq, 4, false) == 4);
+    CHECK(sim.stats.nacks == 2);
+    CHECK(sim.stats.conversions == 1);
+}
+
+//Read at a resolution and check the result is the environment less at
+//most one code of that resolution, the part truncates, and that the
+//read took only the conversion time.
+static void checkResolution(int tempBits, int humBits, uint32_t acqUs){
+    HDC1080Reading reading;
+    int tempLsb = 16500 / (1 << tempBits) + 1;
+    int humLsb = 10000 / (1 << humBits) + 1;
+    uint64_t start;
+
+    CHECK(hdc1080SetResolution(tempBits, humBits) >= 0);
+    start = halTimeUs64();
+    CHECK(readTempHumidity(&reading) == 4);
+    CHECK(halTimeUs64() - start == acqUs);
+
+    CHECK(reading.tempC100 <= envTempC100 + 1);
+    CHECK(reading.tempC100 >= envTempC100 - tempLsb);
+    CHECK(reading.humidity100 <= envHum100 + 1);
+    CHECK(reading.humidity100 >= envHum100 - humLsb);
+}
+
+static void testResolution(){
+    HDC1080Reading reading;
+
+    simReset();
+    CHECK(hdc1080SetResolution(12, 14) == HDC1080_ERROR_RESOLUTION);
+    CHECK(hdc1080SetResolution(14, 10) == HDC1080_ERROR_RESOLUTION);
+    CHECK(sim.config == HDC1080_MODE_ACQ);
+
+    checkResolution(14, 14, HDC1080_TEMP14_US + HDC1080_HUM14_US);
+    checkResolution(11, 11, HDC1080_TEMP11_US + HDC1080_HUM11_US);
+    checkResolution(11, 8, HDC1080_TEMP11_US + HDC1080_HUM8_US);
+    CHECK(sim.config == (HDC1080_MODE_ACQ | HDC1080_TRES_11 | HDC1080_HRES_8));
+    CHECK(sim.stats.nacks == 0);
+
+    //8-bit humidity drops the low byte entirely
+    envHum100 = 5000;
+    CHECK(readTempHumidity(&reading) == 4);
+    CHECK(reading.humidity100 == 5000);
+    envHum100 = 5038;
+    CHECK(readTempHumidity(&reading) == 4);
+    CHECK(reading.humidity100 == 5000);
+    envHum100 = 5040;
+    CHECK(readTempHumidity(&reading) == 4);
+    CHECK(reading.humidity100 == 5039);
+}
+
+static void testRetries(){
+    HDC1080Reading reading;
+    uint8_t config[3] = {HDC1080CONFIGREG, (HDC1080_MODE_ACQ | HDC1080_HRES_11) >> 8, 0};
+    uint64_t start;
+
+    //The part converts at 11-bit humidity while the driver waits for
+    //8-bit, so the first read and two retries are NACKed
+    simReset();
+    CHECK(hdc1080SetResolution(14, 8) >= 0);
+    CHECK(halI2cWrite(HDC1080ADDRESS, config, 3, false) == 3);
+    start = halTimeUs64();
+    CHECK(readTempHumidity(&reading) == 4);
+    CHECK(halTimeUs64() - start == HDC1080_TEMP14_US + HDC1080_HUM8_US + 3 * HDC1080_RETRY_US);
+    CHECK(sim.stats.nacks == 3);
+    CHECK(abs(reading.tempC100 - envTempC100) <= 2);
+
+    //at 14-bit humidity the retries run out first
+    config[1] = HDC1080_MODE_ACQ >> 8;
+    CHECK(halI2cWrite(HDC1080ADDRESS, config, 3, false) == 3);
+    reading.tempC100 = -1;
+    CHECK(readTempHumidity(&reading) == HAL_I2C_ERROR);
+    CHECK(reading.tempC100 == -1);
+    CHECK(sim.stats.nacks == 3 + 1 + HDC1080_READ_RETRIES);
+}
+
+static void testNackFault(){
+    HDC1080Reading reading;
+
+    //a NACKed trigger fails the read and leaves the reading alone
+    simReset();
+    CHECK(hdc1080SetResolution(14, 14) >= 0);
+    hdc1080SimInjectNack(&sim, 1);
+    reading.tempC100 = -1;
+    CHECK(readTempHumidity(&reading) == HAL_I2C_ERROR);
+    CHECK(reading.tempC100 == -1);
+    CHECK(sim.stats.nacks == 1);
+    CHECK(sim.stats.conversions == 0);
+
+    //and the next one goes through
+    CHECK(readTempHumidity(&reading) == 4);
+    CHECK(abs(reading.tempC100 - envTempC100) <= 2);
+}
+
+static void testStuckBus(){
+    HDC1080Reading reading;
+    HDC1080Device dev;
+
+    simReset();
+    hdc1080SimSetStuck(&sim, true);
+    CHECK(readTempHumidity(&reading) == HAL_I2C_TIMEOUT);
+    CHECK(hdc1080Probe(&dev) == HAL_I2C_TIMEOUT);
+    CHECK(hdc1080SetResolution(14, 14) == HAL_I2C_TIMEOUT);
+    CHECK(sim.stats.timeouts == 3);
+    CHECK(sim.stats.nacks == 0);
+
+    hdc1080SimSetStuck(&sim, false);
+    CHECK(readTempHumidity(&reading) == 4);
+    CHECK(sim.stats.timeouts == 3);
+}
+
+static void testCorrupt(){
+    HDC1080Reading good;
+    HDC1080Reading bad;
+
+    //The sensor has no CRC, so a corrupted read is taken as data. The
+    //top bit of each code flipped moves the values by half the range.
+    simReset();
+    CHECK(hdc1080SetResolution(14, 14) >= 0);
+    CHECK(readTempHumidity(&good) == 4);
+    hdc1080SimCorruptNext(&sim, 0x80);
+    CHECK(readTempHumidity(&bad) == 4);
+    CHECK(abs(abs(bad.tempC100 - good.tempC100) - 8282) <= 1);
+    CHECK(abs(abs(bad.humidity100 - good.humidity100) - 5020) <= 1);
+
+    //only the next read
+    CHECK(readTempHumidity(&bad) == 4);
+    CHECK(bad.tempC100 == good.tempC100);
+}
+
+int main(){
+    testProbe();
+    testNoConversion();
+    testNackUntilReady();
+    testResolution();
+    testRetries();
+    testNackFault();
+    testStuckBus();
+    testCorrupt();
+
+    return checkResult();
+}
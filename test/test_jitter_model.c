@@ -0,0 +1,145 @@
+//A sanity model of step timing under interrupt latency, not a
+//measurement. The latency comes from the hand picked busy windows
+//below, rough guesses at what holds up the step alarm on each core
+//layout, so the figures printed only restate those guesses and say
+//nothing about how the layouts compare on the board. That comparison
+//has to be measured on the board, with the 'j' console command on an
+//RT_IO_CORE 0 and an RT_IO_CORE 1 build.
+//
+//What the model does check is the step engine: the step timer is
+//rescheduled from when each step was due, so a late alarm only moves
+//its own step. No step may be off by more than the longest latency
+//any alarm saw, however the windows line up, and the timing summary
+//and jitter histogram must count every step.
+//
+//  - single core: the USB frame interrupt, critical sections, the tick,
+//    console flushes and the display scan share the step timer's core
+//  - io on core 1: only the display scan does
+
+#include <stdio.h>
+
+#include "hal.h"
+#include "step_engine.h"
+#include "latency_hist.h"
+#include "check.h"
+
+#define JITTER_MOVE_STEPS 4000
+
+//time from an alarm falling due to its callback running when nothing
+//is in the way
+#define ALARM_ENTRY_US 1
+
+//a window of every periodUs, starting offsetUs in, lasting lengthUs
+//during which the step alarm cannot run
+typedef struct {
+    const char *name;
+    uint32_t periodUs;
+    uint32_t offsetUs;
+    uint32_t lengthUs;
+} BusyWindow;
+
+typedef struct {
+    const char *name;
+    const BusyWindow *windows;
+    int count;
+} CoreLayout;
+
+static const BusyWindow core0Windows[] = {
+    {"usb frame irq", 1000, 250, 12},
+    {"critical sections", 5000, 1700, 6},
+    {"tick irq", 10000, 4100, 10},
+    {"console flush", 100000, 33000, 40},
+    {"display scan", 1000, 600, 3},
+};
+
+static const BusyWindow core1Windows[] = {
+    {"display scan", 1000, 600, 3},
+};
+
+static const CoreLayout layouts[] = {
+    {"single core (RT_IO_CORE 0)", core0Windows, sizeof(core0Windows) / sizeof(core0Windows[0])},
+    {"io on core 1 (RT_IO_CORE 1)", core1Windows, sizeof(core1Windows) / sizeof(core1Windows[0])},
+};
+
+//longest latency handed to an alarm in the current run
+static uint32_t worstLatencyUs;
+
+//Latency of an alarm due at dueUs: it waits out every window it lands
+//in, including ones that start while it is waiting
+static uint32_t layoutLatency(void *ctx, uint64_t dueUs){
+    const CoreLayout *layout = ctx;
+    uint64_t runUs = dueUs + ALARM_ENTRY_US;
+    bool waited = true;
+
+    while(waited){
+        waited = false;
+        for(int i = 0; i < layout->count; i++){
+            const BusyWindow *w = &layout->windows[i];
+            uint64_t into;
+
+            if(runUs < w->offsetUs){
+                continue;
+            }
+            into = (runUs - w->offsetUs) % w->periodUs;
+            if(into < w->lengthUs){
+                runUs += w->lengthUs - into;
+                waited = true;
+            }
+        }
+    }
+    if(runUs - dueUs > worstLatencyUs){
+        worstLatencyUs = runUs - dueUs;
+    }
+    return runUs - dueUs;
+}
+
+static void moveDone(){
+}
+
+//run the move under a layout's modelled latency and check that no step
+//is off by more than the worst latency of a single alarm
+static void runLayout(const CoreLayout *layout){
+    LatencyHist before;
+    LatencyHist after;
+    LatencyHist move;
+    StepMoveStats stats;
+    uint32_t late;
+
+    worstLatencyUs = 0;
+    stepTimingJitter(&before, &late);
+    halHostSetAlarmLatency(layoutLatency, (void *)layout);
+
+    CHECK(stepEngineLoad(JITTER_MOVE_STEPS));
+    stepEngineStart();
+    while(stepEngineRunning()){
+        halHostAdvanceUs(100000);
+    }
+    halHostSetAlarmLatency(NULL, NULL);
+
+    //the histogram counts since boot, take this move's share
+    stepTimingJitter(&after, &late);
+    move = after;
+    move.total -= before.total;
+    for(int b = 0; b < LAT_BUCKETS; b++){
+        move.counts[b] -= before.counts[b];
+    }
+
+    CHECK(stepTimingLastMove(&stats));
+    CHECK(stats.steps == JITTER_MOVE_STEPS);
+    CHECK(move.total == JITTER_MOVE_STEPS);
+    CHECK(stats.maxErrUs <= (int32_t)worstLatencyUs && -stats.minErrUs <= (int32_t)worstLatencyUs);
+
+    printf("model, %s: step error %ld to %ld us, worst alarm latency %lu us, p99 <= %lu us, %lu late\n",
+           layout->name, (long)stats.minErrUs, (long)stats.maxErrUs,
+           (unsigned long)worstLatencyUs, (unsigned long)histPercentile(&move, 99),
+           (unsigned long)stats.late);
+}
+
+int main(){
+    stepEngineInit(moveDone);
+
+    runLayout(&layouts[0]);
+    runLayout(&layouts[1]);
+
+    return checkResult();
+}
@@ -0,0 +1,182 @@
+//The fullRotateFB() sequence run on the step engine with the motor
+//model on the coil pins: the shaft must come back to where the rotation
+//started without an illegal or over-speed step, in every drive mode.
+//Then the fastest step rate each mode runs at, which its rate limit
+//must keep within what the model follows, and the step timing the
+//engine reports on the way.
+
+#include <stdio.h>
+
+#include "hal.h"
+#include "board.h"
+#include "step_engine.h"
+#include "motor_sim.h"
+#include "check.h"
+
+//as in Assign9.c
+#define ROTATE_STEPS (501 * STEPS_PER_ROTATE)
+#define HOLD_US 500000
+
+//move used to find the fastest rate, long enough to reach any rate
+//tried, and the rate step it is searched in
+#define RATE_MOVE_STEPS 2000
+#define RATE_SEARCH_STEP 25
+#define RATE_SEARCH_LIMIT 4000
+
+static const uint8_t coilPins[4] = {StepMotorIN1, StepMotorIN2, StepMotorIN3, StepMotorIN4};
+
+static MotorSim motor;
+static int movesDone;
+
+static void moveDone(){
+    movesDone++;
+}
+
+//run a loaded move to the end, as motionMove() would
+static void runLoaded(bool loaded){
+    if(!loaded){
+        return;
+    }
+    stepEngineStart();
+    while(stepEngineRunning()){
+        halHostAdvanceUs(10000);
+    }
+}
+
+//a MOTION_MOVE_REL of halfSteps, taken from where the motor is when
+//the move starts
+static void runRel(int32_t halfSteps){
+    runLoaded(stepEngineLoadTo(stepEnginePosition() + halfSteps));
+}
+
+//A move queued ahead, then forward by the rotate count, hold, and back
+//by the same relative distance, as motionTask runs them. The rotation
+//must end where it began, after the move ahead, and the engine and the
+//shaft must agree at every stop.
+static void fullRotateFB(StepMode mode){
+    int32_t start;
+    int32_t shaftStart;
+
+    stepEngineSetMode(mode);
+    runRel(-6);
+    start = stepEnginePosition();
+    shaftStart = motorSimPosition(&motor);
+
+    runRel(2 * ROTATE_STEPS);
+    CHECK(stepEnginePosition() - start == 2 * ROTATE_STEPS);
+    CHECK(motorSimPosition(&motor) - shaftStart == 2 * ROTATE_STEPS);
+
+    halHostAdvanceUs(HOLD_US);
+    CHECK(motorSimPosition(&motor) - shaftStart == 2 * ROTATE_STEPS);
+
+    runRel(-2 * ROTATE_STEPS);
+    CHECK(stepEnginePosition() == start);
+    CHECK(motorSimPosition(&motor) == shaftStart);
+}
+
+//rate the last ramp step runs at, the fastest a move reaches
+static uint32_t peakRate(){
+    return 1000000 / stepEngineRampUs(stepEngineRampLen() - 1);
+}
+
+//Raise the maximum rate until a move no longer runs clean on a fresh
+//model, or the ramp table no longer reaches a higher rate because the
+//mode's rate limit holds it, and return the fastest rate a clean move
+//reached. Every move must keep to its commanded intervals.
+static uint32_t maxRate(StepMode mode){
+    uint32_t best = 0;
+    StepMoveStats stats;
+
+    stepEngineSetMode(mode);
+    for(uint32_t rate = STEP_START_RATE; rate <= RATE_SEARCH_LIMIT; rate += RATE_SEARCH_STEP){
+        stepEngineSetProfile(STEP_START_RATE, rate, STEP_ACCEL);
+        if(peakRate() == best){
+            break;
+        }
+
+        CHECK(motorSimAttach(&motor, coilPins, 0));
+        stepEngineEnergize();
+        runLoaded(stepEngineLoad(RATE_MOVE_STEPS));
+        motorSimDetach(&motor);
+
+        CHECK(stepTimingLastMove(&stats));
+        CHECK(stats.steps == RATE_MOVE_STEPS);
+        CHECK(stats.minErrUs == 0 && stats.maxErrUs == 0 && stats.late == 0);
+
+        if(motor.stats.overSpeed != 0 || motor.stats.illegal != 0){
+            break;
+        }
+        best = peakRate();
+    }
+
+    printf("mode %d: fastest clean rate %u steps/s, %u us per half step\n",
+           mode, (unsigned)best, (unsigned)(1000000 / best / (mode == STEP_MODE_HALF ? 1 : 2)));
+    stepEngineSetProfile(STEP_START_RATE, STEP_MAX_RATE, STEP_ACCEL);
+    return best;
+}
+
+//The default profile runs clean in every mode, and so does every rate
+//up to each mode's limit: the search stops at the limit without the
+//model losing a step. Full and wave steps are two of the model's half
+//steps each, so their limit must sit under half its fastest half step
+//rate.
+static void testMaxRate(){
+    uint32_t full = maxRate(STEP_MODE_FULL);
+    uint32_t half = maxRate(STEP_MODE_HALF);
+    uint32_t wave = maxRate(STEP_MODE_WAVE);
+    uint32_t fastest = 1000000 / MOTOR_SIM_DEFAULT_MIN_HALF_STEP_US;
+
+    CHECK(full >= STEP_MAX_RATE && wave >= STEP_MAX_RATE && half >= STEP_MAX_RATE);
+    CHECK(STEP_RATE_LIMIT_FULL <= fastest / 2);
+    CHECK(full <= STEP_RATE_LIMIT_FULL && full > STEP_RATE_LIMIT_FULL - RATE_SEARCH_STEP);
+    CHECK(wave == full);
+    CHECK(half <= STEP_RATE_LIMIT_HALF && half > STEP_RATE_LIMIT_HALF - RATE_SEARCH_STEP);
+    CHECK(half < fastest);
+
+    //a profile over the limit is held to it, and the limit follows the
+    //mode
+    stepEngineSetMode(STEP_MODE_FULL);
+    stepEngineSetProfile(STEP_START_RATE, RATE_SEARCH_LIMIT, STEP_ACCEL);
+    CHECK(peakRate() == full);
+    stepEngineSetMode(STEP_MODE_HALF);
+    CHECK(peakRate() == half);
+    stepEngineSetProfile(STEP_START_RATE, STEP_MAX_RATE, STEP_ACCEL);
+}
+
+int main(){
+    uint32_t steps;
+
+    stepEngineInit(moveDone);
+    CHECK(motorSimAttach(&motor, coilPins, 0));
+
+    //the rotor lines up with the first phase energized
+    stepEngineEnergize();
+
+    fullRotateFB(STEP_MODE_FULL);
+    fullRotateFB(STEP_MODE_HALF);
+    fullRotateFB(STEP_MODE_WAVE);
+
+    //from a phase of the other parity the first step is a half step
+    stepEngineSetMode(STEP_MODE_HALF);
+    runLoaded(stepEngineLoad(1));
+    fullRotateFB(STEP_MODE_FULL);
+    fullRotateFB(STEP_MODE_WAVE);
+
+    CHECK(movesDone == 16);
+    CHECK(motor.stats.illegal == 0);
+    CHECK(motor.stats.overSpeed == 0);
+    CHECK(motor.stats.minHalfStepUs >= MOTOR_SIM_DEFAULT_MIN_HALF_STEP_US);
+    CHECK(motorSimPosition(&motor) == stepEnginePosition());
+    steps = motor.stats.steps;
+
+    //once detached the model no longer follows the pins
+    motorSimDetach(&motor);
+    runLoaded(stepEngineLoad(8));
+    CHECK(stepEnginePosition() != motorSimPosition(&motor));
+    CHECK(motor.stats.steps == steps);
+
+    testMaxRate();
+    stepEngineRelease();
+
+    return checkResult();
+}
@@ -0,0 +1,279 @@
+//7-segment glyph table checked against the segments the old per-glyph
+//switch statements lit, the one masked write per refresh timed against
+//their nine single pin writes, and the scan interrupt's refresh rate
+//and duty on the virtual clock
+
+#include <stdio.h>
+#include <time.h>
+
+#include "hal.h"
+#include "board.h"
+#include "seg_display.h"
+#include "check.h"
+
+#define BENCH_REFRESHES 200000
+
+//Segments each case of the old segLEDLeft() and segLEDRight() switches
+//drove high. Digits are the same on both sides; status codes 993-999
+//differ only in 993, O on the left and F on the right. 992 came after
+//the switches and is checked on its own.
+#define OLD_STATUS_FIRST 993
+
+static const char *oldDigitSegs[10] = {
+    "ABCDEF", "BC", "ABDEG", "ABCDG", "BCFG",
+    "ACDFG", "ACDEFG", "ABC", "ABCDEFG", "ABCDFG",
+};
+static const char *oldStatusSegs[7] = {
+    "ABCDEF", "ABEFG", "BCEFG", "AEFG", "CDEFG", "ADEF", "ADEFG",
+};
+static const uint8_t segPins[7] = {
+    SevenSegA, SevenSegB, SevenSegC, SevenSegD, SevenSegE, SevenSegF, SevenSegG,
+};
+
+static const char *oldSegs(int value, bool left){
+    if(value >= OLD_STATUS_FIRST){
+        return value == OLD_STATUS_FIRST && !left ? "AEFG" : oldStatusSegs[value - OLD_STATUS_FIRST];
+    }
+    return oldDigitSegs[left ? value / 10 : value % 10];
+}
+
+static bool segOn(const char *segs, int seg){
+    for(; *segs != 0; segs++){
+        if(*segs - 'A' == seg){
+            return true;
+        }
+    }
+    return false;
+}
+
+//One refresh the old way: a gpio_put() per digit select and segment,
+//in the order the switch cases wrote them
+static void switchRefresh(uint32_t select, const char *segs){
+    halGpioPutMasked(SEG_DIGIT_RIGHT, select == SEG_DIGIT_RIGHT ? SEG_DIGIT_RIGHT : 0);
+    halGpioPutMasked(SEG_DIGIT_LEFT, select == SEG_DIGIT_LEFT ? SEG_DIGIT_LEFT : 0);
+    for(int seg = 0; seg < 7; seg++){
+        halGpioPutMasked(SEG_BIT(segPins[seg]), segOn(segs, seg) ? SEG_BIT(segPins[seg]) : 0);
+    }
+}
+
+static void tableRefresh(uint32_t select, uint8_t glyph){
+    halGpioPutMasked(SEG_WRITE_MASK, segDigitBits(select, glyph));
+}
+
+//Every value the display shows lights the same segments from the table
+//as it did from the switches
+static void testGlyphs(){
+    for(int value = 0; value <= SEG_STATUS_LAST; value++){
+        uint32_t oldPins;
+
+        if(value == 100){
+            value = OLD_STATUS_FIRST;
+        }
+
+        switchRefresh(SEG_DIGIT_LEFT, oldSegs(value, true));
+        oldPins = halHostPins() & SEG_WRITE_MASK;
+        tableRefresh(SEG_DIGIT_LEFT, segLeftGlyph(value));
+        CHECK((halHostPins() & SEG_WRITE_MASK) == oldPins);
+
+        switchRefresh(SEG_DIGIT_RIGHT, oldSegs(value, false));
+        oldPins = halHostPins() & SEG_WRITE_MASK;
+        tableRefresh(SEG_DIGIT_RIGHT, segRightGlyph(value));
+        CHECK((halHostPins() & SEG_WRITE_MASK) == oldPins);
+    }
+
+    //992, the sensor error, reads Er
+    CHECK(segLeftGlyph(SEG_STATUS_FIRST) == GLYPH_E);
+    CHECK(segRightGlyph(SEG_STATUS_FIRST) == GLYPH_r);
+    CHECK(segGlyphMasks[GLYPH_r] == (SEG_BIT(SevenSegE) | SEG_BIT(SevenSegG)));
+}
+
+//Pin writes in the log, and how many left the pins in a state that is
+//neither the digit before nor the digit after, each one a chance to
+//light a wrong segment
+static int halfUpdated(uint32_t before, uint32_t after, int *writes){
+    static HalPinWrite log[16];
+    size_t n = halHostPinLog(log, 16);
+    uint32_t pins = before;
+    int count = 0;
+
+    for(size_t i = 0; i < n; i++){
+        pins = (pins & ~log[i].mask) | log[i].value;
+        if((pins & SEG_WRITE_MASK) != before && (pins & SEG_WRITE_MASK) != after){
+            count++;
+        }
+    }
+    *writes = n;
+    return count;
+}
+
+//Scanning 47, the right digit follows the left as the scan interrupt
+//alternates
+static void testHalfUpdated(){
+    uint32_t left;
+    uint32_t right;
+    int switchWrites;
+    int switchHalf;
+    int tableWrites;
+    int tableHalf;
+
+    tableRefresh(SEG_DIGIT_RIGHT, 7);
+    right = halHostPins() & SEG_WRITE_MASK;
+    tableRefresh(SEG_DIGIT_LEFT, 4);
+    left = halHostPins() & SEG_WRITE_MASK;
+
+    halHostPinLogClear();
+    switchRefresh(SEG_DIGIT_RIGHT, oldSegs(47, false));
+    switchHalf = halfUpdated(left, right, &switchWrites);
+
+    tableRefresh(SEG_DIGIT_LEFT, 4);
+    halHostPinLogClear();
+    tableRefresh(SEG_DIGIT_RIGHT, 7);
+    tableHalf = halfUpdated(left, right, &tableWrites);
+
+    printf("per refresh: switch %d writes, %d half updated states; table %d writes, %d\n",
+           switchWrites, switchHalf, tableWrites, tableHalf);
+    CHECK(switchWrites == 9);
+    CHECK(switchHalf > 0);
+    CHECK(tableWrites == 1);
+    CHECK(tableHalf == 0);
+}
+
+static double nowNs(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//Time each digit select has been on, and how often each digit was lit
+//with what, followed from the scan interrupt's writes
+typedef struct {
+    uint64_t lastUs;
+    uint32_t pins;
+    uint64_t onUs[2];           //left, right
+    uint32_t refreshes[2];
+    uint32_t minGapUs;          //shortest and longest time between two
+    uint32_t maxGapUs;          //refreshes of the left digit
+    uint64_t leftUs;
+} ScanWatch;
+
+static ScanWatch scan;
+
+static void scanWatcher(void *ctx, const HalPinWrite *write){
+    ScanWatch *w = ctx;
+    uint32_t pins = (w->pins & ~write->mask) | (write->value & write->mask);
+
+    if(w->pins & SEG_DIGIT_LEFT){
+        w->onUs[0] += write->timeUs - w->lastUs;
+    }
+    if(w->pins & SEG_DIGIT_RIGHT){
+        w->onUs[1] += write->timeUs - w->lastUs;
+    }
+
+    if(pins & SEG_DIGIT_LEFT){
+        if(w->refreshes[0] != 0){
+            uint32_t gap = write->timeUs - w->leftUs;
+
+            w->minGapUs = gap < w->minGapUs ? gap : w->minGapUs;
+            w->maxGapUs = gap > w->maxGapUs ? gap : w->maxGapUs;
+        }
+        w->leftUs = write->timeUs;
+        w->refreshes[0]++;
+    }
+    if(pins & SEG_DIGIT_RIGHT){
+        w->refreshes[1]++;
+    }
+
+    w->pins = pins;
+    w->lastUs = write->timeUs;
+}
+
+static uint64_t shownUs;
+static int shownRuns;
+
+static void frameShown(uint64_t sourceUs){
+    shownUs = sourceUs;
+    shownRuns++;
+}
+
+//One second of scanning on the virtual clock: each digit is refreshed
+//at SEG_SCAN_HZ / 2 with an even period and lit half the time, and a
+//swapped in frame is lit within a scan period and reported once
+static void testScan(){
+    uint64_t start;
+
+    segFramesInit(frameShown);
+    halGpioPutMasked(SEG_WRITE_MASK, 0);
+    scan = (ScanWatch){.lastUs = halTimeUs64(), .minGapUs = UINT32_MAX};
+    CHECK(halHostWatchPins(scanWatcher, &scan));
+
+    start = halTimeUs64();
+    segScanStart();
+    halHostAdvanceUs(500000);
+    segFrameShow(4, 7, 123);
+    halHostAdvanceUs(1000000 / SEG_SCAN_HZ);
+    CHECK((halHostPins() & SEG_WRITE_MASK) == segDigitBits(SEG_DIGIT_LEFT, 4) ||
+          (halHostPins() & SEG_WRITE_MASK) == segDigitBits(SEG_DIGIT_RIGHT, 7));
+    halHostAdvanceUs(500000 - 1000000 / SEG_SCAN_HZ);
+    segScanStop();
+    halHostUnwatchPins(scanWatcher, &scan);
+
+    printf("scan: %u + %u refreshes in %llu us, left lit %llu us, right %llu us, gap %u-%u us\n",
+           (unsigned)scan.refreshes[0], (unsigned)scan.refreshes[1],
+           (unsigned long long)(halTimeUs64() - start),
+           (unsigned long long)scan.onUs[0], (unsigned long long)scan.onUs[1],
+           (unsigned)scan.minGapUs, (unsigned)scan.maxGapUs);
+    CHECK(scan.refreshes[0] == SEG_SCAN_HZ / 2);
+    CHECK(scan.refreshes[1] == SEG_SCAN_HZ / 2);
+    CHECK(scan.minGapUs == 2000000 / SEG_SCAN_HZ && scan.maxGapUs == 2000000 / SEG_SCAN_HZ);
+    //the right digit is first lit a scan period in
+    CHECK(scan.onUs[0] == 500000);
+    CHECK(scan.onUs[1] == 500000 - 1000000 / SEG_SCAN_HZ);
+    CHECK(shownRuns == 1 && shownUs == 123);
+    CHECK((halHostPins() & SEG_WRITE_MASK) == 0);
+}
+
+//The switch cases wrote constants, so the switch path is timed on
+//levels worked out beforehand
+static void benchmark(){
+    uint32_t levels[10][7];
+    double start;
+    double switchNs;
+    double tableNs;
+
+    for(int digit = 0; digit < 10; digit++){
+        for(int seg = 0; seg < 7; seg++){
+            levels[digit][seg] = segOn(oldDigitSegs[digit], seg) ? SEG_BIT(segPins[seg]) : 0;
+        }
+    }
+
+    start = nowNs();
+    for(int i = 0; i < BENCH_REFRESHES; i++){
+        uint32_t select = i & 1 ? SEG_DIGIT_LEFT : SEG_DIGIT_RIGHT;
+
+        halGpioPutMasked(SEG_DIGIT_RIGHT, select & SEG_DIGIT_RIGHT);
+        halGpioPutMasked(SEG_DIGIT_LEFT, select & SEG_DIGIT_LEFT);
+        for(int seg = 0; seg < 7; seg++){
+            halGpioPutMasked(SEG_BIT(segPins[seg]), levels[i % 10][seg]);
+        }
+    }
+    switchNs = nowNs() - start;
+
+    start = nowNs();
+    for(int i = 0; i < BENCH_REFRESHES; i++){
+        tableRefresh(i & 1 ? SEG_DIGIT_LEFT : SEG_DIGIT_RIGHT, i % 10);
+    }
+    tableNs = nowNs() - start;
+
+    printf("switch %.1f ns, table %.1f ns per refresh (host)\n",
+           switchNs / BENCH_REFRESHES, tableNs / BENCH_REFRESHES);
+}
+
+int main(){
+    testGlyphs();
+    testHalfUpdated();
+    testScan();
+    benchmark();
+
+    return checkResult();
+}
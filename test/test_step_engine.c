@@ -0,0 +1,181 @@
+//Step engine drive modes: the position always follows the coils, and
+//changing mode between moves never jumps the rotor. A move whose timer
+//cannot start ends at once.
+
+#include "hal.h"
+#include "board.h"
+#include "hrtimer.h"
+#include "step_engine.h"
+#include "check.h"
+
+#define COIL(pin) (1u << (pin))
+#define COIL_MASK (COIL(StepMotorIN1) | COIL(StepMotorIN2) | COIL(StepMotorIN3) | COIL(StepMotorIN4))
+
+//half step cycle IN1, IN1+IN2, IN2, ... as in step_engine.c
+static const uint32_t halfCycle[8] = {
+    COIL(StepMotorIN1),
+    COIL(StepMotorIN1) | COIL(StepMotorIN2),
+    COIL(StepMotorIN2),
+    COIL(StepMotorIN2) | COIL(StepMotorIN3),
+    COIL(StepMotorIN3),
+    COIL(StepMotorIN3) | COIL(StepMotorIN4),
+    COIL(StepMotorIN4),
+    COIL(StepMotorIN4) | COIL(StepMotorIN1),
+};
+
+static int movesDone;
+
+static void moveDone(){
+    movesDone++;
+}
+
+//coils the engine should have on at its position, which starts at 0 on
+//phase 1
+static uint32_t expectedCoils(){
+    return halfCycle[(stepEnginePosition() + 1) & 7];
+}
+
+static int coilsOn(uint32_t pins){
+    return __builtin_popcount(pins & COIL_MASK);
+}
+
+//run a move to the end, returns how far the position moved
+static int32_t runMove(int32_t steps){
+    int32_t start = stepEnginePosition();
+
+    CHECK(stepEngineLoad(steps));
+    CHECK(stepEngineStart());
+    halHostAdvanceUs(2000000);
+    CHECK(!stepEngineRunning());
+
+    return stepEnginePosition() - start;
+}
+
+//run a move to target to the end, returns how far the position moved
+static int32_t runMoveTo(int32_t target){
+    int32_t start = stepEnginePosition();
+
+    CHECK(stepEngineLoadTo(target));
+    CHECK(stepEngineStart());
+    halHostAdvanceUs(2000000);
+    CHECK(!stepEngineRunning());
+
+    return stepEnginePosition() - start;
+}
+
+static bool idleTimer(void *arg){
+    return false;
+}
+
+//With every alarm slot taken the step timer cannot start. The move
+//must end without a step and still call the done callback, or the
+//task waiting for it would block forever.
+static void testStartFails(){
+    static HrTimer fill[64];
+    int filled = 0;
+    int32_t start = stepEnginePosition();
+    int done = movesDone;
+
+    while(filled < 64 && hrTimerStart(&fill[filled], 1000000, 0, idleTimer, NULL)){
+        filled++;
+    }
+    CHECK(filled < 64);
+
+    CHECK(stepEngineLoad(4));
+    CHECK(stepEngineRunning());
+    CHECK(!stepEngineStart());
+    CHECK(!stepEngineRunning());
+    CHECK(movesDone == done + 1);
+    CHECK(stepEnginePosition() == start);
+
+    for(int i = 0; i < filled; i++){
+        hrTimerCancel(&fill[i]);
+    }
+
+    //and the next move runs
+    CHECK(runMove(2) == 4);
+}
+
+//every pin write since the log was cleared has count coils on
+static void checkMoveCoils(int count){
+    static HalPinWrite log[64];
+    size_t n = halHostPinLog(log, 64);
+
+    for(size_t i = 0; i < n; i++){
+        CHECK(coilsOn(log[i].value) == count);
+    }
+}
+
+int main(){
+    stepEngineInit(moveDone);
+
+    //starts in the drive mode on a full step phase
+    CHECK(stepEngineStepsPerFullStep() == 1);
+    halHostPinLogClear();
+    CHECK(runMove(4) == 8);
+    CHECK((halHostPins() & COIL_MASK) == expectedCoils());
+    checkMoveCoils(2);
+
+    //half step lands on a one coil phase
+    stepEngineSetMode(STEP_MODE_HALF);
+    CHECK(stepEngineStepsPerFullStep() == 2);
+    CHECK(runMove(1) == 1);
+    CHECK(coilsOn(halHostPins()) == 1);
+    CHECK((halHostPins() & COIL_MASK) == expectedCoils());
+
+    //Back to full step. Changing mode moves nothing, the first step is
+    //a half step back onto two coils.
+    stepEngineSetMode(STEP_MODE_FULL);
+    CHECK(coilsOn(halHostPins()) == 1);
+    halHostPinLogClear();
+    CHECK(runMove(2) == 3);
+    CHECK((halHostPins() & COIL_MASK) == expectedCoils());
+    checkMoveCoils(2);
+
+    //wave drive from a two coil phase, backwards
+    stepEngineSetMode(STEP_MODE_WAVE);
+    halHostPinLogClear();
+    CHECK(runMove(-3) == -5);
+    CHECK((halHostPins() & COIL_MASK) == expectedCoils());
+    checkMoveCoils(1);
+
+    //wave to full and back, both already aligned after one step
+    stepEngineSetMode(STEP_MODE_FULL);
+    halHostPinLogClear();
+    CHECK(runMove(-2) == -3);
+    checkMoveCoils(2);
+    CHECK((halHostPins() & COIL_MASK) == expectedCoils());
+
+    //Steps to an absolute position. Full steps from a one coil phase
+    //start with a half step, and end with one onto a target of that
+    //parity.
+    stepEngineSetMode(STEP_MODE_HALF);
+    CHECK(runMove(1) == 1);
+    stepEngineSetMode(STEP_MODE_FULL);
+    CHECK(stepEngineStepsTo(stepEnginePosition() + 5) == 3);
+    CHECK(stepEngineStepsTo(stepEnginePosition() - 6) == -4);
+    int32_t target = stepEnginePosition() - 7;
+    CHECK(runMoveTo(target) == -7);
+    CHECK(stepEngineStepsTo(target) == 0);
+    CHECK(!stepEngineLoadTo(target));
+    CHECK(stepEngineStepsTo(target + 3) == 2);
+    CHECK(runMoveTo(target + 3) == 3);
+    CHECK((halHostPins() & COIL_MASK) == expectedCoils());
+    CHECK(coilsOn(halHostPins()) == 1);
+    CHECK(runMoveTo(target) == -3);
+    stepEngineSetMode(STEP_MODE_HALF);
+    CHECK(stepEngineStepsTo(target + 3) == 3);
+    stepEngineSetMode(STEP_MODE_FULL);
+
+    //energize holds the phase it is on
+    stepEngineRelease();
+    CHECK(coilsOn(halHostPins()) == 0);
+    stepEngineEnergize();
+    CHECK((halHostPins() & COIL_MASK) == expectedCoils());
+
+    CHECK(movesDone == 9);
+
+    testStartFails();
+
+    return checkResult();
+}
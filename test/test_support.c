@@ -0,0 +1,14 @@
+//Shared by the host tests, see test_support.h
+
+#include "hal.h"
+#include "hrtimer.h"
+#include "test_support.h"
+
+void (*testSleepHook)(uint32_t us);
+
+void hrSleepUs(uint32_t us){
+    halHostAdvanceUs(us);
+    if(testSleepHook != NULL){
+        testSleepHook(us);
+    }
+}
@@ -0,0 +1,13 @@
+//Shared by the host tests, linked into each of them
+
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <stdint.h>
+
+//hrtimer.h leaves hrSleepUs() to the RTOS code. The test one moves the
+//virtual clock on by the wait and then calls testSleepHook, if a test
+//set it, as the end of a blocking wait.
+extern void (*testSleepHook)(uint32_t us);
+
+#endif
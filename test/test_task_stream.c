@@ -0,0 +1,202 @@
+//Task snapshot frames: encoding, and decoding them back out of console
+//text that has corrupt and cut off frames mixed in, whole and fed a
+//few bytes at a time as taskdump reads a serial capture. Then trace
+//frames written from a ring that has wrapped, as traceDump() does, and
+//read back as tracedump does.
+
+#include <string.h>
+
+#include "task_stream.h"
+#include "check.h"
+
+static TaskRecord tasks[3] = {
+    {1, 0, 3, 3, 120, 5000, "IDLE"},
+    {2, 2, 5, 4, 64, 123456, "readHDC1080Task"},
+    {3, 3, 2, 2, 0, 0xFFFFFFFF, "stepMotorTask"},
+};
+
+static uint8_t stream[4096];
+static size_t streamLen;
+
+static void append(const void *data, size_t len){
+    memcpy(&stream[streamLen], data, len);
+    streamLen += len;
+}
+
+static void testEncode(){
+    uint8_t frame[TASK_STREAM_FRAME_MAX];
+    size_t len = taskStreamEncode(frame, sizeof(frame), tasks, 3);
+    uint16_t sum;
+
+    CHECK(len == TASK_STREAM_OVERHEAD + 3 * sizeof(TaskRecord));
+    CHECK(sizeof(TaskRecord) == 10 + TASK_STREAM_NAME_LEN);
+    CHECK(memcmp(frame, TASK_STREAM_MAGIC, 4) == 0);
+    CHECK((frame[4] | frame[5] << 8) == 1 + 3 * sizeof(TaskRecord));
+    CHECK(frame[6] == 3);
+
+    sum = taskStreamChecksum(&frame[4], len - 6);
+    CHECK(frame[len - 2] == (sum & 0xFF) && frame[len - 1] == sum >> 8);
+
+    //Fletcher-16 check value of "abcde"
+    CHECK(taskStreamChecksum((const uint8_t *)"abcde", 5) == 0xC8F0);
+
+    CHECK(taskStreamEncode(frame, len - 1, tasks, 3) == 0);
+    CHECK(taskStreamEncode(frame, sizeof(frame), tasks, TASK_STREAM_MAX_TASKS + 1) == 0);
+}
+
+//text, a good frame, a corrupt copy, an empty frame, then the first
+//part of another good frame
+static size_t buildStream(uint8_t *good, size_t *goodLen){
+    uint8_t frame[TASK_STREAM_FRAME_MAX];
+    size_t len;
+    size_t cut;
+
+    streamLen = 0;
+    append("boot\r\nTSK2 in text\r\n", 20);
+    *goodLen = taskStreamEncode(good, TASK_STREAM_FRAME_MAX, tasks, 3);
+    append(good, *goodLen);
+    append("hum 45%\r\n", 9);
+
+    memcpy(frame, good, *goodLen);
+    frame[20] ^= 0x04;
+    append(frame, *goodLen);
+
+    len = taskStreamEncode(frame, sizeof(frame), tasks, 0);
+    append(frame, len);
+
+    cut = streamLen;
+    append(good, 30);
+    return cut;
+}
+
+static void testDecode(){
+    static uint8_t good[TASK_STREAM_FRAME_MAX];
+    static TaskFrame frame;
+    size_t goodLen;
+    size_t cut = buildStream(good, &goodLen);
+    size_t pos = 0;
+    size_t end;
+    size_t keep;
+
+    end = taskStreamDecode(stream, streamLen, &frame, &keep);
+    CHECK(end == 20 + goodLen && keep == end);
+    CHECK(frame.count == 3);
+    CHECK(memcmp(frame.records, tasks, sizeof(tasks)) == 0);
+    pos += end;
+
+    //the corrupt copy is skipped, the empty frame found
+    end = taskStreamDecode(&stream[pos], streamLen - pos, &frame, &keep);
+    CHECK(end != 0 && frame.count == 0);
+    CHECK(pos + end == cut);
+    pos += end;
+
+    //the cut off frame is kept until the rest arrives
+    end = taskStreamDecode(&stream[pos], streamLen - pos, &frame, &keep);
+    CHECK(end == 0 && keep == 0);
+    append(&good[30], goodLen - 30);
+    end = taskStreamDecode(&stream[pos], streamLen - pos, &frame, &keep);
+    CHECK(end == goodLen && frame.count == 3);
+}
+
+//Feed the stream a few bytes at a time, keeping what is not done with
+//as taskdump does
+static void testStreaming(){
+    static uint8_t good[TASK_STREAM_FRAME_MAX];
+    static uint8_t buf[2 * TASK_STREAM_FRAME_MAX];
+    static TaskFrame frame;
+    size_t goodLen;
+    size_t len = 0;
+    int frames = 0;
+    int tasksSeen = 0;
+
+    buildStream(good, &goodLen);
+    append(&good[30], goodLen - 30);
+    append("done\r\n", 6);
+
+    for(size_t pos = 0; pos < streamLen; pos += 7){
+        size_t chunk = streamLen - pos < 7 ? streamLen - pos : 7;
+        size_t end;
+        size_t keep;
+
+        memcpy(&buf[len], &stream[pos], chunk);
+        len += chunk;
+        while((end = taskStreamDecode(buf, len, &frame, &keep)) != 0){
+            frames++;
+            tasksSeen += frame.count;
+            memmove(buf, &buf[end], len - end);
+            len -= end;
+        }
+        memmove(buf, &buf[keep], len - keep);
+        len -= keep;
+    }
+
+    CHECK(frames == 3);
+    CHECK(tasksSeen == 6);
+}
+
+static TraceName traceNames[2] = {
+    {TRACE_NAME_TASK, 3, "stepMotorTask"},
+    {TRACE_NAME_QUEUE, 1, "smButtonQueue"},
+};
+
+//a wrapped ring: the oldest events are at the end
+static TraceEvent traceRing[6] = {
+    {1040, 2, 3, 1}, {1050, 1, 3, 3}, {1000, 0, 3, 3},
+    {1010, 4, 3, 2}, {1020, 5, 3, 0}, {1030, 3, 3, 1},
+};
+
+static void appendPut(const uint8_t *data, size_t len){
+    append(data, len);
+}
+
+static void testTrace(){
+    static TraceFrame frame;
+    static TaskFrame taskFrame;
+    static TraceEvent many[TASK_TRACE_MAX_EVENTS + 1];
+    size_t frameStart;
+    size_t frameLen;
+    size_t end;
+    size_t keep;
+
+    streamLen = 0;
+    append("dump\r\nTRC1\r\n", 12);
+    frameStart = streamLen;
+    CHECK(taskTraceWrite(appendPut, traceNames, 2, &traceRing[2], 4, traceRing, 2));
+    frameLen = streamLen - frameStart;
+    CHECK(frameLen == TASK_STREAM_OVERHEAD + 2 * sizeof(TraceName) + 6 * sizeof(TraceEvent));
+
+    //a corrupt copy, then the first part of a good one
+    append(&stream[frameStart], frameLen);
+    stream[streamLen - 5] ^= 0x10;
+    append(&stream[frameStart], 20);
+
+    end = taskTraceDecode(stream, streamLen, &frame, &keep);
+    CHECK(end == frameStart + frameLen && keep == end);
+    CHECK(frame.nameCount == 2 && memcmp(frame.names, traceNames, sizeof(traceNames)) == 0);
+    CHECK(frame.eventCount == 6);
+    for(int i = 0; i < frame.eventCount; i++){
+        CHECK(frame.events[i].timeUs == 1000 + 10 * i);
+    }
+
+    //the corrupt copy is skipped and the cut off frame kept
+    CHECK(taskTraceDecode(&stream[end], streamLen - end, &frame, &keep) == 0);
+    CHECK(keep == frameLen);
+
+    //task snapshot frames are not trace frames
+    CHECK(taskStreamDecode(stream, streamLen, &taskFrame, &keep) == 0);
+
+    //too many events or names writes nothing
+    streamLen = 0;
+    CHECK(!taskTraceWrite(appendPut, traceNames, 2, many, TASK_TRACE_MAX_EVENTS, many, 1));
+    CHECK(!taskTraceWrite(appendPut, traceNames, TASK_TRACE_MAX_NAMES + 1, many, 0, many, 0));
+    CHECK(streamLen == 0);
+}
+
+int main(){
+    testEncode();
+    testDecode();
+    testStreaming();
+    testTrace();
+
+    return checkResult();
+}
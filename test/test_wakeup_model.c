@@ -0,0 +1,158 @@
+//A sanity model of the idle time of the sensor and motor tasks before
+//and after they were made to block until there is work, not a
+//measurement. The RTOS is not in the host build, so the wakeups are
+//replayed against the sensor model on the virtual clock and CPU time
+//is charged from assumed costs:
+//
+//  - each task wakeup, with its context switches and one pass through
+//    the task loop, costs WAKE_US, a guess for the M0+ at 125 MHz
+//  - I2C transfers busy-wait the CPU for 9 bit times per byte, address
+//    byte included, at the 100 kHz bus clock
+//  - everything else is idle time; the display scan and step timer
+//    interrupts are the same in both and left out
+//
+//The percentages printed follow from those guesses. The real idle time
+//is the IDLE task's share in the 't' console command, read on the
+//board before and after the change.
+//
+//Before, stepMotorTask took buttonSem with a one tick timeout, so it
+//woke on every tick. readHDC1080Task did the same and then read
+//temperature and humidity separately, each after a 100 ms delay.
+//After, stepMotorTask wakes when a reading is published and
+//readHDC1080Task once per HDC1080_SAMPLE_MS, with one acquisition.
+
+#include <stdio.h>
+
+#include "hal.h"
+#include "hdc1080.h"
+#include "hdc1080_sim.h"
+#include "check.h"
+#include "test_support.h"
+
+#define WAKE_US 20
+#define I2C_BYTE_US 90
+#define TICK_US 10000               //configTICK_RATE_HZ 100
+#define HDC1080_SAMPLE_MS 500       //as in Assign9.c
+#define OLD_READ_DELAY_US 100000    //vTaskDelay(100) in the old reads
+#define MODEL_SECONDS 60
+
+static HDC1080Sim sim;
+static uint32_t wakeups;
+static uint64_t busyUs;
+
+static void wake(){
+    wakeups++;
+    busyUs += WAKE_US;
+}
+
+//busy time of the transfers the sensor saw since the last call, with
+//the bytes each read returned
+static void countI2c(uint32_t readBytes){
+    static HDC1080SimStats last;
+
+    busyUs += (uint64_t)(sim.stats.writes - last.writes) * 2 * I2C_BYTE_US;
+    busyUs += (uint64_t)(sim.stats.reads - last.reads) * (1 + readBytes) * I2C_BYTE_US;
+    last = sim.stats;
+}
+
+//the readTempHumidity() wait blocks the task, so the end of it is a
+//wakeup
+static void sleepWake(uint32_t us){
+    wake();
+}
+
+//print and return the idle percentage in tenths since start
+static uint32_t idlePermille(const char *name, uint64_t start){
+    uint64_t elapsed = halTimeUs64() - start;
+    uint32_t permille = 1000 - busyUs * 1000 / elapsed;
+
+    printf("model, %s: %u wakeups/s, %u us busy/s, idle %u.%u%%\n", name,
+           (unsigned)(wakeups / MODEL_SECONDS), (unsigned)(busyUs / MODEL_SECONDS),
+           (unsigned)(permille / 10), (unsigned)(permille % 10));
+    return permille;
+}
+
+//One pass of the old readHDC1080Task loop: the one tick semaphore
+//timeout, then temperature and humidity each from their own conversion
+static void oldSensorLoop(){
+    uint8_t reg;
+    uint8_t raw[2];
+
+    halHostAdvanceUs(TICK_US);
+    wake();
+
+    reg = HDC1080TEMPREG;
+    CHECK(halI2cWrite(HDC1080ADDRESS, &reg, 1, false) == 1);
+    halHostAdvanceUs(OLD_READ_DELAY_US);
+    wake();
+    CHECK(halI2cRead(HDC1080ADDRESS, raw, 2, false) == 2);
+
+    reg = HDC1080HUMREG;
+    CHECK(halI2cWrite(HDC1080ADDRESS, &reg, 1, false) == 1);
+    halHostAdvanceUs(OLD_READ_DELAY_US);
+    wake();
+    CHECK(halI2cRead(HDC1080ADDRESS, raw, 2, false) == 2);
+    countI2c(2);
+}
+
+static uint32_t modelBefore(){
+    uint64_t start = halTimeUs64();
+    uint64_t end = start + MODEL_SECONDS * 1000000ull;
+
+    wakeups = 0;
+    busyUs = 0;
+    while(halTimeUs64() < end){
+        oldSensorLoop();
+    }
+
+    //stepMotorTask polled once a tick the whole time
+    for(uint64_t t = start; t < halTimeUs64(); t += TICK_US){
+        wake();
+    }
+    return idlePermille("before", start);
+}
+
+static uint32_t modelAfter(){
+    HDC1080Reading reading;
+    uint64_t start = halTimeUs64();
+    uint64_t end = start + MODEL_SECONDS * 1000000ull;
+    uint64_t next = start;
+
+    wakeups = 0;
+    busyUs = 0;
+    while(next < end){
+        //the sample timeout runs out
+        halHostAdvanceUs(next - halTimeUs64());
+        wake();
+        CHECK(readTempHumidity(&reading) == 4);
+        countI2c(4);
+
+        //the published reading wakes stepMotorTask
+        wake();
+
+        next += HDC1080_SAMPLE_MS * 1000;
+    }
+    halHostAdvanceUs(end - halTimeUs64());
+    return idlePermille("after", start);
+}
+
+int main(){
+    uint32_t before;
+    uint32_t after;
+
+    testSleepHook = sleepWake;
+    hdc1080SimAttach(&sim, HDC1080ADDRESS);
+    CHECK(hdc1080Init() >= 0);
+    countI2c(0);
+
+    before = modelBefore();
+    after = modelAfter();
+
+    //Three wakeups per sample after, 6 a second. That count follows
+    //from the task loops; the idle figures only from the assumed costs.
+    CHECK(wakeups == MODEL_SECONDS * 1000 / HDC1080_SAMPLE_MS * 3);
+    CHECK(after > before);
+    CHECK(sim.stats.nacks == 0);
+
+    return checkResult();
+}
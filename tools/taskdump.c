@@ -0,0 +1,85 @@
+//Print the task snapshot frames in a console capture. Reads the capture
+//from a file, or stdin when none is given, copies console text through
+//unchanged and prints each frame ('b' on the console) as a task table
+//in its place. Frames that fail their length or checksum are dropped
+//as text.
+//
+//  taskdump capture.bin
+//  cat /dev/ttyACM0 | taskdump
+
+#include <stdio.h>
+#include <string.h>
+
+#include "task_stream.h"
+
+#define DUMP_BUF (4 * TASK_STREAM_FRAME_MAX)
+
+//state letters as listTasks() prints them, by eTaskState
+static const char stateChar[] = {'X', 'R', 'B', 'S', 'D', 'I'};
+
+static void printFrame(const TaskFrame *frame){
+    printf("task_n           task_s  priority  base  ss    tn  run_us\n");
+    for(int i = 0; i < frame->count; i++){
+        const TaskRecord *task = &frame->records[i];
+        char name[TASK_STREAM_NAME_LEN + 1];
+
+        memcpy(name, task->name, TASK_STREAM_NAME_LEN);
+        name[TASK_STREAM_NAME_LEN] = '\0';
+        printf("%-16s %c       %-8u  %-5u %-5u %-3u %lu\n", name,
+               task->state < sizeof(stateChar) ? stateChar[task->state] : '?',
+               task->priority, task->basePriority, task->stackFree, task->number,
+               (unsigned long)task->runTimeUs);
+    }
+    if(frame->count == 0){
+        printf("(no tasks, more than the firmware's snapshot holds)\n");
+    }
+}
+
+int main(int argc, char **argv){
+    static uint8_t buf[DUMP_BUF];
+    static TaskFrame frame;
+    FILE *in = stdin;
+    size_t len = 0;
+    size_t got;
+
+    if(argc > 2){
+        fprintf(stderr, "usage: %s [capture]\n", argv[0]);
+        return 2;
+    }
+    if(argc == 2 && (in = fopen(argv[1], "rb")) == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+
+    do{
+        size_t end;
+        size_t keep;
+
+        got = fread(&buf[len], 1, sizeof(buf) - len, in);
+        len += got;
+
+        //print the text before each frame, then the frame
+        while((end = taskStreamDecode(buf, len, &frame, &keep)) != 0){
+            size_t start = end - (TASK_STREAM_OVERHEAD + frame.count * sizeof(TaskRecord));
+
+            fwrite(buf, 1, start, stdout);
+            printFrame(&frame);
+            memmove(buf, &buf[end], len - end);
+            len -= end;
+        }
+
+        //at the end of the input, or when it fills the buffer, a cut off
+        //frame is only text
+        if(got == 0 || (keep == 0 && len == sizeof(buf))){
+            keep = len;
+        }
+        fwrite(buf, 1, keep, stdout);
+        memmove(buf, &buf[keep], len - keep);
+        len -= keep;
+    } while(got != 0);
+
+    if(in != stdin){
+        fclose(in);
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+//Turn the trace frames in a console capture ('r' on the console) into
+//Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open
+//directly. Reads the capture from a file, or stdin when none is given,
+//skips the console text and writes the last trace frame in it to
+//stdout. Task run time becomes a slice on the task's track, everything
+//else an instant event.
+//
+//  tracedump capture.bin > trace.json
+//  cat /dev/ttyACM0 | tracedump > trace.json
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOSConfig.h"
+#include "task_stream.h"
+
+#define DUMP_BUF (2 * TASK_TRACE_FRAME_MAX)
+
+//name of a task or queue number in frame, or fallback
+static const char *traceName(const TraceFrame *frame, uint8_t kind, unsigned number, const char *fallback){
+    static char name[TASK_STREAM_NAME_LEN + 1];
+
+    for(int i = 0; i < frame->nameCount; i++){
+        if(frame->names[i].kind == kind && frame->names[i].number == number){
+            memcpy(name, frame->names[i].name, TASK_STREAM_NAME_LEN);
+            name[TASK_STREAM_NAME_LEN] = '\0';
+            return name;
+        }
+    }
+    return fallback;
+}
+
+static const char *taskName(const TraceFrame *frame, unsigned n){
+    return traceName(frame, TRACE_NAME_TASK, n, "task");
+}
+
+static const char *queueName(const TraceFrame *frame, unsigned n){
+    return traceName(frame, TRACE_NAME_QUEUE, n, "queue");
+}
+
+//print the frame as Chrome trace JSON, times from the first event
+static void printJson(const TraceFrame *frame){
+    const char *sep = "";
+    uint32_t t0 = frame->eventCount != 0 ? frame->events[0].timeUs : 0;
+
+    printf("{\"traceEvents\":[\n");
+    for(int i = 0; i < frame->nameCount; i++){
+        if(frame->names[i].kind == TRACE_NAME_TASK){
+            printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                   sep, frame->names[i].number, taskName(frame, frame->names[i].number));
+            sep = ",\n";
+        }
+    }
+
+    for(int i = 0; i < frame->eventCount; i++){
+        const TraceEvent *entry = &frame->events[i];
+        unsigned long ts = entry->timeUs - t0;
+
+        printf("%s{\"pid\":0,\"tid\":%u,\"ts\":%lu,", sep, entry->task, ts);
+        switch(entry->event){
+            case TRACE_SWITCH_IN:
+                printf("\"ph\":\"B\",\"name\":\"%s\"}", taskName(frame, entry->object));
+                break;
+            case TRACE_SWITCH_OUT:
+                printf("\"ph\":\"E\",\"name\":\"%s\"}", taskName(frame, entry->object));
+                break;
+            case TRACE_QUEUE_SEND:
+                printf("\"ph\":\"i\",\"s\":\"t\",\"name\":\"send %s\"}", queueName(frame, entry->object));
+                break;
+            case TRACE_QUEUE_RECEIVE:
+                printf("\"ph\":\"i\",\"s\":\"t\",\"name\":\"receive %s\"}", queueName(frame, entry->object));
+                break;
+            case TRACE_NOTIFY:
+                printf("\"ph\":\"i\",\"s\":\"t\",\"name\":\"notify %s\"}", taskName(frame, entry->object));
+                break;
+            default:
+                printf("\"ph\":\"i\",\"s\":\"t\",\"name\":\"wait notify %u\"}", entry->object);
+                break;
+        }
+        sep = ",\n";
+    }
+    printf("\n]}\n");
+}
+
+int main(int argc, char **argv){
+    static uint8_t buf[DUMP_BUF];
+    static TraceFrame frame;
+    static TraceFrame last;
+    FILE *in = stdin;
+    size_t len = 0;
+    size_t got;
+    int frames = 0;
+
+    if(argc > 2){
+        fprintf(stderr, "usage: %s [capture]\n", argv[0]);
+        return 2;
+    }
+    if(argc == 2 && (in = fopen(argv[1], "rb")) == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+
+    do{
+        size_t end;
+        size_t keep;
+
+        got = fread(&buf[len], 1, sizeof(buf) - len, in);
+        len += got;
+
+        while((end = taskTraceDecode(buf, len, &frame, &keep)) != 0){
+            last = frame;
+            frames++;
+            memmove(buf, &buf[end], len - end);
+            len -= end;
+        }
+
+        //a cut off frame that fills the buffer is not a frame
+        if(keep == 0 && len == sizeof(buf)){
+            keep = len;
+        }
+        memmove(buf, &buf[keep], len - keep);
+        len -= keep;
+    } while(got != 0);
+
+    if(in != stdin){
+        fclose(in);
+    }
+
+    if(frames == 0){
+        fprintf(stderr, "no trace frame found\n");
+        return 1;
+    }
+    if(frames > 1){
+        fprintf(stderr, "%d trace frames, writing the last\n", frames);
+    }
+    printJson(&last);
+    return 0;
+}